@@ -25,5 +25,5 @@ timeout 120 cppcheck \
     --suppress=missingIncludeSystem --suppress=noValidConfiguration \
     --suppress=normalCheckLevelMaxBranches \
     --suppress=preprocessorErrorDirective \
-    -D_GNU_SOURCE -D__linux__ \
+    -D_GNU_SOURCE -D__linux__ -I examples/tpool \
     "${SOURCES[@]}"
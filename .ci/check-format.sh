@@ -34,6 +34,6 @@ while IFS= read -r -d '' file; do
     if ! diff -u -p --label="$file" --label="expected coding style" "$file" "$expected"; then
         ret=1
     fi
-done < <(git ls-files -z -- 'examples/*.c')
+done < <(git ls-files -z -- 'examples/*.c' 'examples/*.h')
 
 exit $ret
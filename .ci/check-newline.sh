@@ -18,6 +18,6 @@ while IFS= read -r -d '' f; do
             ret=1
         fi
     fi
-done < <(git ls-files -z -- 'examples/*.c')
+done < <(git ls-files -z -- 'examples/*.c' 'examples/*.h')
 
 exit $ret
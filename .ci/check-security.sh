@@ -100,7 +100,7 @@ while IFS= read -r -d '' f; do
         grep -nE "$dangerous_pp" <<<"$code"
         failed=1
     fi
-done < <(git ls-files -z -- 'examples/*.c')
+done < <(git ls-files -z -- 'examples/*.c' 'examples/*.h')
 
 if [ $failed -eq 0 ]; then
     echo "Security checks passed."
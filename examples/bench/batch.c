@@ -0,0 +1,96 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* Submit bursts of empty jobs one add_job at a time and with one add_jobs
+ * per burst, through either kind of shared queue. The jobs do nothing, so
+ * what is left is the cost of getting them into the pool and their results
+ * back out.
+ */
+
+static void *nop(void *arg)
+{
+    return arg;
+}
+
+static int run(bool batched, enum tpool_queue queue, int threads, int jobs,
+               int burst)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .queue = queue };
+    struct tpool_future **futures = malloc(sizeof(*futures) * burst);
+    void **args = calloc(burst, sizeof(*args));
+    if (!futures || !args || !tpool_init(&pool, threads)) {
+        free(futures);
+        free(args);
+        return -1;
+    }
+    tpool_run(&pool);
+
+    uint64_t submit = 0, start = bench_now_ns();
+    for (int done = 0; done < jobs; done += burst) {
+        int n = jobs - done < burst ? jobs - done : burst;
+        uint64_t t = bench_now_ns();
+        int added = 0;
+        if (batched) {
+            added = add_jobs(&pool, nop, args, n, futures);
+        } else {
+            while (added < n && (futures[added] = add_job(&pool, nop, NULL)))
+                added++;
+        }
+        submit += bench_now_ns() - t;
+        for (int i = 0; i < added; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+        }
+        if (added < n) {
+            fprintf(stderr, "failed to add job %d.\n", done + added);
+            tpool_destroy(&pool);
+            free(futures);
+            free(args);
+            return -1;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    free(futures);
+    free(args);
+
+    printf("%s,%s,%d,%d,%d,%.1f,%.0f\n", batched ? "add_jobs" : "add_job",
+           queue == TPOOL_QUEUE_LIST ? "list" : "ring", threads, burst, jobs,
+           (double)submit / jobs, jobs * 1e9 / elapsed);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), jobs = 1000000, burst = 1000, opt;
+    while ((opt = getopt(argc, argv, "t:n:b:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            jobs = bench_arg(optarg, "job count");
+            break;
+        case 'b':
+            burst = bench_arg(optarg, "burst size");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n jobs] [-b burst]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("submit,queue,threads,burst,jobs,submit_ns_per_job,jobs_per_sec\n");
+    for (int q = TPOOL_QUEUE_RING; q <= TPOOL_QUEUE_LIST; q++) {
+        if (run(false, q, threads, jobs, burst) ||
+            run(true, q, threads, jobs, burst))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbp.h"
+#include "bench.h"
+#include "tpool.h"
+
+/* Burn-in: the BBP series summed in chunks of -c terms, one job per chunk,
+ * for each kernel and a thread count doubling up to -t. "book" is the job
+ * the book's rmw_example.c runs instead, one term per job with pow and a
+ * malloc'ed result, for comparison; it ignores -c.
+ *
+ * Everything the jobs touch is allocated before the clock starts, so the
+ * time is the pool's and the arithmetic's. The chunks are added up in order
+ * afterwards, and the result checked against pi.
+ */
+
+/* the book's bbp(), one term per job */
+static void *book_job(void *arg)
+{
+    long k = *(long *)arg;
+    double sum = (4.0 / (8 * k + 1)) - (2.0 / (8 * k + 4)) -
+                 (1.0 / (8 * k + 5)) - (1.0 / (8 * k + 6));
+    double *product = malloc(sizeof(double));
+    if (!product)
+        return NULL;
+    *product = 1 / pow(16, k) * sum;
+    return product;
+}
+
+/* Milliseconds to sum n terms on a fresh pool, with the result in *pi, or
+ * -1 if it went wrong. kernel is NULL for the book's jobs.
+ */
+static double run(const struct bbp_kernel *kernel, int threads, long n,
+                  long chunk, double *pi)
+{
+    long jobs = kernel ? (n + chunk - 1) / chunk : n;
+    struct bbp_chunk *chunks = malloc(sizeof(*chunks) * jobs);
+    long *terms = malloc(sizeof(*terms) * jobs);
+    double *partial = malloc(sizeof(*partial) * jobs);
+    void **args = malloc(sizeof(*args) * jobs);
+    struct tpool_future **futures = malloc(sizeof(*futures) * jobs);
+    struct tpool_batch *batch = tpool_batch_create(jobs);
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    double ms = -1;
+    if (!chunks || !terms || !partial || !args || !futures || !batch ||
+        !tpool_init(&pool, threads))
+        goto out;
+    for (long i = 0; i < jobs; i++) {
+        if (kernel) {
+            long end = (i + 1) * chunk < n ? (i + 1) * chunk : n;
+            chunks[i] = (struct bbp_chunk){ .begin = i * chunk,
+                                            .end = end,
+                                            .sum = kernel->sum,
+                                            .partial = &partial[i] };
+            args[i] = &chunks[i];
+        } else {
+            terms[i] = i;
+            args[i] = &terms[i];
+        }
+    }
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    size_t added = tpool_batch_add(&pool, batch,
+                                   kernel ? bbp_chunk_job : book_job, args,
+                                   jobs, futures);
+    tpool_batch_wait(batch);
+    uint64_t elapsed = bench_now_ns() - start;
+
+    *pi = 0;
+    for (size_t i = 0; i < added; i++) {
+        if (!kernel) {
+            if (!futures[i]->result)
+                added = 0;
+            else
+                partial[i] = *(double *)futures[i]->result;
+        }
+        tpool_future_destroy(futures[i]);
+    }
+    for (size_t i = 0; i < added; i++)
+        *pi += partial[i];
+    if (added == (size_t)jobs)
+        ms = elapsed / 1e6;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+out:
+    tpool_batch_destroy(batch);
+    free(futures);
+    free(args);
+    free(partial);
+    free(terms);
+    free(chunks);
+    return ms;
+}
+
+static int report(const char *name, const struct bbp_kernel *kernel,
+                  int threads, long n, long chunk)
+{
+    double pi;
+    double ms = run(kernel, threads, n, chunk, &pi);
+    if (ms < 0) {
+        fprintf(stderr, "%s: the pool failed.\n", name);
+        return -1;
+    }
+    /* a few roundings per chunk at most: anything more is a wrong sum */
+    if (fabs(pi - M_PI) > 1e-14) {
+        fprintf(stderr, "%s: pi came out as %.17g.\n", name, pi);
+        return -1;
+    }
+    printf("%s,%d,%ld,%ld,%.3f,%.1f,%.3g\n", name, threads, n,
+           kernel ? chunk : 1, ms, n / ms / 1e3, pi - M_PI);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long n = 1 << 22, chunk = 4096;
+    const char *only = NULL;
+    while ((opt = getopt(argc, argv, "t:n:c:k:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "term count");
+            break;
+        case 'c':
+            chunk = bench_arg(optarg, "chunk size");
+            break;
+        case 'k':
+            only = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n terms] [-c chunk] "
+                    "[-k kernel]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("kernel,threads,terms,chunk,ms,mterms_per_sec,error\n");
+    int found = 0;
+    for (size_t i = 0; i <= BBP_KERNELS; i++) {
+        /* the book's jobs last, past the end of the table */
+        const struct bbp_kernel *kernel =
+            i < BBP_KERNELS ? &bbp_kernels[i] : NULL;
+        const char *name = kernel ? kernel->name : "book";
+        if (only && strcmp(only, name))
+            continue;
+        found = 1;
+        if (kernel && !bbp_available(kernel)) {
+            fprintf(stderr, "%s: not supported by this CPU.\n", name);
+            continue;
+        }
+        for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+            if (report(name, kernel, t, n, chunk))
+                return EXIT_FAILURE;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "unknown kernel: '%s'\n", only);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
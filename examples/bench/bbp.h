@@ -0,0 +1,264 @@
+#ifndef BENCH_BBP_H
+#define BENCH_BBP_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/* The Bailey-Borwein-Plouffe series of rmw_example.c, as a kernel that sums
+ * a whole range of terms at a time. It is the workload the pool is burned in
+ * with, so it is written to cost arithmetic only: no pow, since consecutive
+ * powers of 1/16 are one exact multiplication apart, no allocation, and the
+ * terms of a range computed several at once in SIMD lanes.
+ *
+ * Each term comes out bit for bit as the book's bbp() computes it: the
+ * powers are exact, and vector division and multiplication round like the
+ * scalar ones do. Only the order of the additions differs.
+ */
+
+/* From here on, the book's pow(16, k) overflows to infinity and every term it
+ * computes is zero. 16^-k itself is still a double for a while, but summing
+ * it would no longer match the book, so the kernels stop here too.
+ */
+#define BBP_TERMS_NONZERO 256
+
+/* 16^-k, exactly */
+static inline double bbp_power(long k)
+{
+    return k < BBP_TERMS_NONZERO ? ldexp(1.0, (int)(-4 * k)) : 0;
+}
+
+/* the end of a range, less the terms that are zero */
+static inline long bbp_end(long end)
+{
+    return end < BBP_TERMS_NONZERO ? end : BBP_TERMS_NONZERO;
+}
+
+static inline double bbp_term(long k, double power)
+{
+    double sum = (4.0 / (8 * k + 1)) - (2.0 / (8 * k + 4)) -
+                 (1.0 / (8 * k + 5)) - (1.0 / (8 * k + 6));
+    return power * sum;
+}
+
+/* Terms begin to end - 1, one after the other. */
+static inline double bbp_sum_scalar(long begin, long end)
+{
+    double sum = 0, power = bbp_power(begin);
+    end = bbp_end(end);
+    for (long k = begin; k < end; k++, power *= 1.0 / 16)
+        sum += bbp_term(k, power);
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Two terms at a time, which every x86-64 has. */
+__attribute__((target("sse2")))
+static inline double bbp_sum_sse2(long begin, long end)
+{
+    __m128d k = _mm_set_pd((double)(begin + 1), (double)begin);
+    __m128d power = _mm_set_pd(bbp_power(begin + 1), bbp_power(begin));
+    __m128d sum = _mm_setzero_pd();
+    const __m128d step = _mm_set1_pd(1.0 / 256), two = _mm_set1_pd(2);
+    const __m128d one = _mm_set1_pd(1), four = _mm_set1_pd(4),
+                  five = _mm_set1_pd(5), six = _mm_set1_pd(6),
+                  eight = _mm_set1_pd(8);
+    long i = begin;
+    end = bbp_end(end);
+    for (; i + 2 <= end; i += 2) {
+        __m128d k8 = _mm_mul_pd(eight, k);
+        __m128d t = _mm_div_pd(four, _mm_add_pd(k8, one));
+        t = _mm_sub_pd(t, _mm_div_pd(two, _mm_add_pd(k8, four)));
+        t = _mm_sub_pd(t, _mm_div_pd(one, _mm_add_pd(k8, five)));
+        t = _mm_sub_pd(t, _mm_div_pd(one, _mm_add_pd(k8, six)));
+        sum = _mm_add_pd(sum, _mm_mul_pd(power, t));
+        power = _mm_mul_pd(power, step);
+        k = _mm_add_pd(k, two);
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    return lanes[0] + lanes[1] + bbp_sum_scalar(i, end);
+}
+
+/* Four terms at a time, on the CPUs that have AVX2. */
+__attribute__((target("avx2")))
+static inline double bbp_sum_avx2(long begin, long end)
+{
+    __m256d k = _mm256_set_pd((double)(begin + 3), (double)(begin + 2),
+                              (double)(begin + 1), (double)begin);
+    __m256d power = _mm256_set_pd(bbp_power(begin + 3), bbp_power(begin + 2),
+                                  bbp_power(begin + 1), bbp_power(begin));
+    __m256d sum = _mm256_setzero_pd();
+    const __m256d step = _mm256_set1_pd(1.0 / 65536);
+    const __m256d one = _mm256_set1_pd(1), two = _mm256_set1_pd(2),
+                  four = _mm256_set1_pd(4), five = _mm256_set1_pd(5),
+                  six = _mm256_set1_pd(6), eight = _mm256_set1_pd(8);
+    long i = begin;
+    end = bbp_end(end);
+    for (; i + 4 <= end; i += 4) {
+        __m256d k8 = _mm256_mul_pd(eight, k);
+        __m256d t = _mm256_div_pd(four, _mm256_add_pd(k8, one));
+        t = _mm256_sub_pd(t, _mm256_div_pd(two, _mm256_add_pd(k8, four)));
+        t = _mm256_sub_pd(t, _mm256_div_pd(one, _mm256_add_pd(k8, five)));
+        t = _mm256_sub_pd(t, _mm256_div_pd(one, _mm256_add_pd(k8, six)));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(power, t));
+        power = _mm256_mul_pd(power, step);
+        k = _mm256_add_pd(k, four);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           bbp_sum_scalar(i, end);
+}
+
+static inline bool bbp_have_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(__aarch64__)
+/* Two terms at a time; every AArch64 core has NEON with doubles. */
+static inline double bbp_sum_neon(long begin, long end)
+{
+    float64x2_t k = { (double)begin, (double)(begin + 1) };
+    float64x2_t power = { bbp_power(begin), bbp_power(begin + 1) };
+    float64x2_t sum = vdupq_n_f64(0);
+    const float64x2_t step = vdupq_n_f64(1.0 / 256);
+    const float64x2_t one = vdupq_n_f64(1), two = vdupq_n_f64(2),
+                      four = vdupq_n_f64(4), five = vdupq_n_f64(5),
+                      six = vdupq_n_f64(6), eight = vdupq_n_f64(8);
+    long i = begin;
+    end = bbp_end(end);
+    for (; i + 2 <= end; i += 2) {
+        float64x2_t k8 = vmulq_f64(eight, k);
+        float64x2_t t = vdivq_f64(four, vaddq_f64(k8, one));
+        t = vsubq_f64(t, vdivq_f64(two, vaddq_f64(k8, four)));
+        t = vsubq_f64(t, vdivq_f64(one, vaddq_f64(k8, five)));
+        t = vsubq_f64(t, vdivq_f64(one, vaddq_f64(k8, six)));
+        /* not vfmaq: a fused multiply-add would round the term differently */
+        sum = vaddq_f64(sum, vmulq_f64(power, t));
+        power = vmulq_f64(power, step);
+        k = vaddq_f64(k, two);
+    }
+    return vgetq_lane_f64(sum, 0) + vgetq_lane_f64(sum, 1) +
+           bbp_sum_scalar(i, end);
+}
+#endif
+
+struct bbp_kernel {
+    const char *name;
+    double (*sum)(long begin, long end);
+    bool (*available)(void); /* NULL if it always is */
+};
+
+/* Every kernel this target has, the best last. */
+static const struct bbp_kernel bbp_kernels[] = {
+    { "scalar", bbp_sum_scalar, NULL },
+#if defined(__x86_64__) || defined(__i386__)
+    { "sse2", bbp_sum_sse2, NULL },
+    { "avx2", bbp_sum_avx2, bbp_have_avx2 },
+#elif defined(__aarch64__)
+    { "neon", bbp_sum_neon, NULL },
+#endif
+};
+
+#define BBP_KERNELS (sizeof(bbp_kernels) / sizeof(bbp_kernels[0]))
+
+static inline bool bbp_available(const struct bbp_kernel *kernel)
+{
+    return !kernel->available || kernel->available();
+}
+
+/* The best kernel this CPU runs. */
+static inline const struct bbp_kernel *bbp_best(void)
+{
+    size_t i = BBP_KERNELS;
+    while (!bbp_available(&bbp_kernels[--i]))
+        ;
+    return &bbp_kernels[i];
+}
+
+/* Digit extraction, after Bailey, Borwein and Plouffe: the hex digits of pi
+ * from any position on, without computing the ones before. Multiplying the
+ * series by 16^d shifts the digits wanted to just after the point, and the
+ * whole part that would need precision for the digits before is thrown away
+ * term by term, by reducing 16^(d - k) modulo each denominator. So every
+ * block of digits is an independent job of about d modular exponentiations.
+ *
+ * A double holds 13 hex digits, of which rounding over d terms eats a few;
+ * a block is 8, which stays clear of that well past position 10^7.
+ */
+#define BBP_HEX_BLOCK 8
+
+/* m must be below 2^32, so that the products fit in 64 bits */
+static inline uint64_t bbp_pow16_mod(uint64_t e, uint64_t m)
+{
+    uint64_t r = 1 % m, b = 16 % m;
+    for (; e; e >>= 1) {
+        if (e & 1)
+            r = r * b % m;
+        b = b * b % m;
+    }
+    return r;
+}
+
+/* The fractional part of the sum over k of 16^(d - k) / (8k + j). */
+static inline double bbp_series(int j, long d)
+{
+    double s = 0;
+    for (long k = 0; k <= d; k++) {
+        uint64_t m = 8 * (uint64_t)k + j;
+        s += (double)bbp_pow16_mod(d - k, m) / m;
+        s -= floor(s);
+    }
+    /* past d the terms are fractions already, and soon too small to count */
+    double power = 1.0 / 16;
+    for (long k = d + 1; power > 1e-17; k++, power /= 16)
+        s += power / (8 * k + j);
+    return s - floor(s);
+}
+
+/* The largest d bbp_hex_digits takes: its denominators stay below 2^32. */
+#define BBP_HEX_MAX ((1L << 29) - 1)
+
+/* The BBP_HEX_BLOCK hex digits of pi from position d after the point on,
+ * counting from 0, most significant first: 0x243F6A88 for d = 0.
+ */
+static inline uint32_t bbp_hex_digits(long d)
+{
+    double x = 4 * bbp_series(1, d) - 2 * bbp_series(4, d) -
+               bbp_series(5, d) - bbp_series(6, d);
+    x -= floor(x);
+    uint32_t digits = 0;
+    for (int i = 0; i < BBP_HEX_BLOCK; i++) {
+        x *= 16;
+        int digit = (int)x;
+        digits = digits << 4 | digit;
+        x -= digit;
+    }
+    return digits;
+}
+
+/* A job summing one chunk of the series into its slot of an array that was
+ * allocated, with the chunks, before any job ran.
+ */
+struct bbp_chunk {
+    long begin, end;
+    double (*sum)(long begin, long end);
+    double *partial;
+};
+
+static inline void *bbp_chunk_job(void *arg)
+{
+    struct bbp_chunk *chunk = arg;
+    *chunk->partial = chunk->sum(chunk->begin, chunk->end);
+    return NULL;
+}
+
+#endif
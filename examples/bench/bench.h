@@ -0,0 +1,83 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Helpers shared by the benchmark drivers. Everything they print is CSV with
+ * a header line, so results from different runs and machines can be pasted
+ * into one sheet and compared column by column.
+ */
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* CPU time consumed by every thread of the process so far */
+static inline uint64_t bench_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void bench_sleep_ns(uint64_t ns)
+{
+    struct timespec ts = { .tv_sec = ns / 1000000000,
+                           .tv_nsec = ns % 1000000000 };
+    while (thrd_sleep(&ts, &ts) == -1)
+        ;
+}
+
+static inline int bench_ncpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* p-th percentile of n samples, which this sorts in place */
+static inline uint64_t bench_percentile(uint64_t *samples, size_t n, double p)
+{
+    if (n == 0)
+        return 0;
+    qsort(samples, n, sizeof(*samples), bench_cmp_u64);
+    size_t i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return samples[i < n ? i : n - 1];
+}
+
+/* The thread count after t in a sweep up to max: powers of two, and always
+ * max itself last. Past max once t is max.
+ */
+static inline int bench_next_threads(int t, int max)
+{
+    return t < max && t * 2 > max ? max : t * 2;
+}
+
+/* Parse a positive integer option, or exit with a usage error. atoi would
+ * quietly turn a typo into zero threads.
+ */
+static inline long bench_arg(const char *s, const char *what)
+{
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || v <= 0) {
+        fprintf(stderr, "invalid %s: '%s'\n", what, s);
+        exit(EXIT_FAILURE);
+    }
+    return v;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef BENCH_BOOK_H
+#define BENCH_BOOK_H
+
+/* The body of book_rmw_burst and book_aba_burst. It is included right after
+ * one of the book's programs, whose tpool_t, add_job and friends it uses as
+ * they stand; the file including both renames main and the functions the
+ * tpool library also exports, so the book's code itself is untouched.
+ */
+static int book_burst(int threads, struct bench_job *jobs, size_t n,
+                      uint64_t *elapsed)
+{
+    struct tpool_future **futures = malloc(sizeof(*futures) * n);
+    if (!futures)
+        return -1;
+    tpool_t thrd_pool = { .initialized = ATOMIC_FLAG_INIT };
+    if (!tpool_init(&thrd_pool, threads)) {
+        free(futures);
+        return -1;
+    }
+
+    /* a fresh pool is idle, which is when the book's pool takes jobs */
+    uint64_t start = bench_now_ns();
+    size_t added = 0;
+    for (; added < n; added++) {
+        jobs[added].submitted = bench_now_ns();
+        futures[added] = add_job(&thrd_pool, bench_job_run, &jobs[added]);
+        if (!futures[added])
+            break;
+    }
+    atomic_store(&thrd_pool.state, running);
+    for (size_t i = 0; i < added; i++) {
+        tpool_future_wait(futures[i]);
+        tpool_future_destroy(futures[i]);
+    }
+    *elapsed = bench_now_ns() - start;
+
+    /* as in the book's main: let the workers say they are done first */
+    wait_until(&thrd_pool, idle);
+    tpool_destroy(&thrd_pool);
+    free(futures);
+    return added == n ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/* The pool of rmw_example.c, exactly as the book prints it, for bench/suite.
+ * Its main() and the names the tpool library also defines are renamed out of
+ * the way; see book.h.
+ */
+#define main book_rmw_main
+#define add_job book_rmw_add_job
+#define tpool_future_wait book_rmw_future_wait
+#define tpool_future_destroy book_rmw_future_destroy
+#include "../rmw_example.c"
+
+#include "pools.h"
+#include "book.h"
+
+int book_rmw_burst(int threads, struct bench_job *jobs, size_t n,
+                   uint64_t *elapsed)
+{
+    return book_burst(threads, jobs, n, elapsed);
+}
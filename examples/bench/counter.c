@@ -0,0 +1,151 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "counter.h"
+
+/* Threads each bump one count -n times, two ways:
+ *
+ *     atomic   one atomic_long under fetch_add, as in simple_aba_example.c
+ *     sharded  a struct counter of tpool/counter.h, each thread on its own
+ *              slot, as the pool's workers count their jobs
+ *
+ * Increments per second are over all threads. read_ns is what reading the
+ * count costs afterwards, counter_read for the sharded one, and exact_read_ns
+ * counter_read_exact; for the atomic both are the one load. The total has to
+ * come out right, or the run fails.
+ */
+
+enum count_kind { COUNT_ATOMIC, COUNT_SHARDED, COUNT_KINDS };
+
+static const char *const count_names[] = { "atomic", "sharded" };
+
+#define READS 1000
+
+struct shared {
+    enum count_kind kind;
+    _Alignas(CACHE_LINE_SIZE) atomic_long atomic;
+    struct counter sharded;
+    long n;
+    atomic_int ready;
+    atomic_bool go;
+};
+
+struct thread {
+    struct shared *s;
+    int slot;
+};
+
+static int bump(void *arg)
+{
+    struct thread *t = arg;
+    struct shared *s = t->s;
+    atomic_fetch_add(&s->ready, 1);
+    while (!atomic_load_explicit(&s->go, memory_order_acquire))
+        thrd_yield();
+    if (s->kind == COUNT_ATOMIC) {
+        for (long i = 0; i < s->n; i++)
+            atomic_fetch_add_explicit(&s->atomic, 1, memory_order_relaxed);
+    } else {
+        for (long i = 0; i < s->n; i++)
+            counter_add(&s->sharded, t->slot, 1);
+    }
+    return 0;
+}
+
+static long read_count(struct shared *s, bool exact)
+{
+    if (s->kind == COUNT_ATOMIC)
+        return atomic_load_explicit(&s->atomic, memory_order_relaxed);
+    return exact ? counter_read_exact(&s->sharded)
+                 : counter_read(&s->sharded);
+}
+
+/* Nanoseconds per read of the count. */
+static double time_reads(struct shared *s, bool exact)
+{
+    volatile long sink = 0;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < READS; i++)
+        sink += read_count(s, exact);
+    (void)sink;
+    return (double)(bench_now_ns() - start) / READS;
+}
+
+/* Milliseconds for n increments per thread, or -1. */
+static double run(struct shared *s, struct thread *threads, thrd_t *ids,
+                  int n_threads)
+{
+    atomic_init(&s->ready, 0);
+    atomic_init(&s->go, false);
+    int started = 0;
+    for (; started < n_threads; started++) {
+        threads[started].s = s;
+        threads[started].slot = started;
+        if (thrd_create(&ids[started], bump, &threads[started]) !=
+            thrd_success)
+            break;
+    }
+    while (atomic_load(&s->ready) < started)
+        thrd_yield();
+    uint64_t start = bench_now_ns();
+    atomic_store_explicit(&s->go, true, memory_order_release);
+    for (int i = 0; i < started; i++)
+        thrd_join(ids[i], NULL);
+    uint64_t elapsed = bench_now_ns() - start;
+    return started == n_threads && read_count(s, true) == s->n * n_threads
+               ? elapsed / 1e6
+               : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 64, opt;
+    long n = 1000000;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "increment count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n increments]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct shared *s = aligned_alloc(_Alignof(struct shared), sizeof(*s));
+    struct thread *t = malloc(sizeof(*t) * threads);
+    thrd_t *ids = malloc(sizeof(*ids) * threads);
+    if (!s || !t || !ids)
+        return EXIT_FAILURE;
+    s->n = n;
+
+    printf("counter,threads,increments,ms,increments_per_sec,read_ns,"
+           "exact_read_ns\n");
+    for (int kind = 0; kind < COUNT_KINDS; kind++) {
+        s->kind = kind;
+        for (int k = 1; k <= threads; k = bench_next_threads(k, threads)) {
+            atomic_init(&s->atomic, 0);
+            if (!counter_init(&s->sharded, k))
+                return EXIT_FAILURE;
+            double ms = run(s, t, ids, k);
+            if (ms < 0) {
+                fprintf(stderr, "%s lost an increment.\n", count_names[kind]);
+                return EXIT_FAILURE;
+            }
+            printf("%s,%d,%ld,%.3f,%.0f,%.1f,%.1f\n", count_names[kind], k,
+                   n * k, ms, n * k / ms * 1e3, time_reads(s, false),
+                   time_reads(s, true));
+            counter_destroy(&s->sharded);
+        }
+    }
+    free(ids);
+    free(t);
+    free(s);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "pools.h"
+#include "tpool.h"
+
+/* A pool of up to -t workers, 64 by default as in the book's listing, three
+ * ways:
+ *
+ *     fixed    every worker started by tpool_init, as before
+ *     elastic  one started, the rest as the work calls for
+ *     target   elastic, with tpool_set_target holding it to half the size
+ *
+ * Each is timed from tpool_init to the first job done, which is what a
+ * short-lived command pays before it gets anything done, then given a burst
+ * of -n jobs of -w nanoseconds each. The workers running are counted at the
+ * end of the burst, and once more after the pool has sat idle for a few
+ * times -i milliseconds, by which time the surplus should have retired.
+ */
+
+struct run {
+    double startup_us;
+    double burst_ms;
+    int busy;
+    int idle;
+};
+
+static void *nop(void *arg)
+{
+    return arg;
+}
+
+static bool run(int mode, int threads, long n, uint64_t work, int idle_ms,
+                struct bench_job *jobs, struct tpool_future **futures,
+                struct run *r)
+{
+    uint64_t start = bench_now_ns();
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .min_threads = mode ? 1 : 0,
+                     .idle_ms = idle_ms };
+    if (!tpool_init(&pool, threads))
+        return false;
+    if (mode == 2 &&
+        !tpool_set_target(&pool, threads > 1 ? threads / 2 : 1)) {
+        tpool_destroy(&pool);
+        return false;
+    }
+    tpool_run(&pool);
+    struct tpool_future *first = add_job(&pool, nop, NULL);
+    if (!first) {
+        tpool_destroy(&pool);
+        return false;
+    }
+    tpool_future_wait(first);
+    tpool_future_destroy(first);
+    r->startup_us = (bench_now_ns() - start) / 1e3;
+
+    start = bench_now_ns();
+    long added = 0;
+    for (; added < n; added++) {
+        jobs[added] = (struct bench_job){ .work_ns = work };
+        futures[added] = add_job(&pool, bench_job_run, &jobs[added]);
+        if (!futures[added])
+            break;
+    }
+    for (long i = 0; i < added; i++) {
+        tpool_future_wait(futures[i]);
+        tpool_future_destroy(futures[i]);
+    }
+    r->burst_ms = (bench_now_ns() - start) / 1e6;
+    r->busy = tpool_active(&pool);
+    tpool_wait_idle(&pool);
+
+    bench_sleep_ns((uint64_t)idle_ms * 5 * 1000000);
+    r->idle = tpool_active(&pool);
+    tpool_destroy(&pool);
+    return added == n;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 64, idle_ms = 20, opt;
+    long n = 20000, work = 10000;
+    while ((opt = getopt(argc, argv, "t:n:w:i:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "job count");
+            break;
+        case 'w':
+            work = bench_arg(optarg, "job size");
+            break;
+        case 'i':
+            idle_ms = bench_arg(optarg, "idle timeout");
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n jobs] [-w ns] [-i ms]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct bench_job *jobs = malloc(sizeof(*jobs) * n);
+    struct tpool_future **futures = malloc(sizeof(*futures) * n);
+    if (!jobs || !futures)
+        return EXIT_FAILURE;
+    static const char *const mode_names[] = { "fixed", "elastic", "target" };
+    printf("mode,max_threads,startup_us,jobs,burst_ms,active_after_burst,"
+           "active_after_idle\n");
+    for (int mode = 0; mode < 3; mode++) {
+        struct run r;
+        if (!run(mode, threads, n, work, idle_ms, jobs, futures, &r)) {
+            fprintf(stderr, "the pool failed.\n");
+            return EXIT_FAILURE;
+        }
+        printf("%s,%d,%.1f,%ld,%.3f,%d,%d\n", mode_names[mode], threads,
+               r.startup_us, n, r.burst_ms, r.busy, r.idle);
+    }
+    free(futures);
+    free(jobs);
+    return EXIT_SUCCESS;
+}
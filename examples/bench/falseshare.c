@@ -0,0 +1,153 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* What sharing cache lines between unrelated futures costs. The first test
+ * has every thread bump a flag of its own, the flags laid out the way futures
+ * used to be, 24 bytes apart, and then one cache line apart as they are now.
+ * The second waits for bursts of jobs one future at a time and through one
+ * batch, whose bits put the completions of 30 jobs on a single word.
+ *
+ * On a single core nothing is shared between caches and both layouts run
+ * alike; the gap grows with the cores the threads spread over.
+ */
+
+#define PACKED_STRIDE 24 /* sizeof the old struct tpool_future */
+
+struct flags_arg {
+    atomic_int *flag;
+    int iters;
+};
+
+static int bump(void *arg)
+{
+    struct flags_arg *a = arg;
+    for (int i = 0; i < a->iters; i++)
+        atomic_fetch_add(a->flag, 1);
+    return 0;
+}
+
+static int run_flags(size_t stride, int threads, int iters)
+{
+    char *base = aligned_alloc(CACHE_LINE_SIZE,
+                               (stride * threads + CACHE_LINE_SIZE - 1) /
+                                   CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+    thrd_t *tids = malloc(sizeof(*tids) * threads);
+    struct flags_arg *args = malloc(sizeof(*args) * threads);
+    if (!base || !tids || !args) {
+        free(base);
+        free(tids);
+        free(args);
+        return -1;
+    }
+
+    uint64_t start = bench_now_ns();
+    int started = 0;
+    for (; started < threads; started++) {
+        args[started].flag = (atomic_int *)(base + stride * started);
+        args[started].iters = iters;
+        atomic_init(args[started].flag, 0);
+        if (thrd_create(&tids[started], bump, &args[started]) != thrd_success)
+            break;
+    }
+    for (int i = 0; i < started; i++)
+        thrd_join(tids[i], NULL);
+    uint64_t elapsed = bench_now_ns() - start;
+    free(base);
+    free(tids);
+    free(args);
+    if (started < threads)
+        return -1;
+
+    printf("flags,%s,%d,%d,%.2f\n",
+           stride < CACHE_LINE_SIZE ? "packed" : "padded", threads, iters,
+           (double)elapsed / iters);
+    return 0;
+}
+
+static void *nop(void *arg)
+{
+    return arg;
+}
+
+static int run_wait(bool batched, int threads, int jobs, int burst)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    struct tpool_future **futures = malloc(sizeof(*futures) * burst);
+    void **args = calloc(burst, sizeof(*args));
+    if (!futures || !args || !tpool_init(&pool, threads)) {
+        free(futures);
+        free(args);
+        return -1;
+    }
+    tpool_run(&pool);
+
+    int failed = 0;
+    uint64_t start = bench_now_ns();
+    for (int done = 0; done < jobs && !failed; done += burst) {
+        int n = jobs - done < burst ? jobs - done : burst, added;
+        if (batched) {
+            struct tpool_batch *batch = tpool_batch_create(n);
+            if (!batch) {
+                failed = 1;
+                break;
+            }
+            added = tpool_batch_add(&pool, batch, nop, args, n, futures);
+            tpool_batch_wait(batch);
+            tpool_batch_destroy(batch);
+        } else {
+            added = add_jobs(&pool, nop, args, n, futures);
+            for (int i = 0; i < added; i++)
+                tpool_future_wait(futures[i]);
+        }
+        for (int i = 0; i < added; i++)
+            tpool_future_destroy(futures[i]);
+        failed = added < n;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    free(futures);
+    free(args);
+    if (failed) {
+        fprintf(stderr, "failed to add jobs.\n");
+        return -1;
+    }
+
+    printf("wait,%s,%d,%d,%.2f\n", batched ? "batch" : "futures", threads,
+           jobs, (double)elapsed / jobs);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), n = 10000000, opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "iteration count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n iterations]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("test,variant,threads,ops,ns_per_op\n");
+    if (run_flags(PACKED_STRIDE, threads, n) ||
+        run_flags(CACHE_LINE_SIZE, threads, n))
+        return EXIT_FAILURE;
+    /* jobs cost a good deal more than flag bumps: run fewer */
+    int jobs = n / 10 > 0 ? n / 10 : 1;
+    if (run_wait(false, threads, jobs, 1000) ||
+        run_wait(true, threads, jobs, 1000))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
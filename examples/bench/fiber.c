@@ -0,0 +1,199 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbp.h"
+#include "bench.h"
+#include "tpool.h"
+
+/* The BBP series over -n terms, divide and conquer: a job halves its range,
+ * adds a job for the left half, does the right half itself and then waits
+ * for the left, down to ranges of -g terms. Every job but the first is added
+ * from inside a job and waited on by one, on pools of a thread count doubling
+ * up to -t, each scheduling both ways and waiting two, or only the one -p
+ * names:
+ *
+ *     help    tpool_future_wait as it is by default: the waiting job runs
+ *             other jobs on top of itself until its own child is done
+ *     fibers  the pool with "fibers": the waiting job stops, and its worker
+ *             goes on with other jobs on another fiber
+ *
+ * Each of those waits for the left half two ways: always on its future, and
+ * "mixed", every other level on a batch of one with tpool_batch_wait. So a
+ * job waiting on a batch has jobs below it that stop on a future, and are
+ * handed back while it waits.
+ *
+ * The halves are always added up in the same order, so every run has to
+ * come out bit for bit the same, and close to pi. A grain of a few terms
+ * over a few hundred thousand nests help deep enough to run a worker out of
+ * stack; fibers take it on the shared queue too, but best with stealing,
+ * where the jobs stopped at any one time are few.
+ */
+
+struct split {
+    tpool_t *pool;
+    long begin, end;
+    long grain;
+    bool mixed; /* wait on a batch at every other level */
+    int depth;
+};
+
+static void *split_job(void *arg);
+
+static double split_sum(const struct split *s)
+{
+    if (s->end - s->begin <= s->grain)
+        return bbp_sum_scalar(s->begin, s->end);
+    long mid = s->begin + (s->end - s->begin) / 2;
+    struct split left = *s, right = *s;
+    left.end = right.begin = mid;
+    left.depth = right.depth = s->depth + 1;
+    struct tpool_batch *batch =
+        s->mixed && s->depth % 2 ? tpool_batch_create(1) : NULL;
+    struct tpool_future *future = NULL;
+    if (batch) {
+        void *args[] = { &left };
+        tpool_batch_add(s->pool, batch, split_job, args, 1, &future);
+    } else {
+        future = add_job(s->pool, split_job, &left);
+    }
+    double sum = split_sum(&right);
+    if (!future) {
+        tpool_batch_destroy(batch);
+        return split_sum(&left) + sum;
+    }
+    if (batch)
+        tpool_batch_wait(batch);
+    else
+        tpool_future_wait(future);
+    tpool_batch_destroy(batch);
+    /* out of memory somewhere below: make the sum come out wrong */
+    double half = future->result ? *(double *)future->result : NAN;
+    tpool_future_destroy(future);
+    return half + sum;
+}
+
+static void *split_job(void *arg)
+{
+    double *sum = tpool_result_alloc(sizeof(double));
+    if (sum)
+        *sum = split_sum(arg);
+    return sum;
+}
+
+/* jobs split_sum adds over a range of n */
+static long split_jobs(long n, long grain)
+{
+    if (n <= grain)
+        return 0;
+    return 1 + split_jobs(n / 2, grain) + split_jobs(n - n / 2, grain);
+}
+
+/* Milliseconds the sum took on a fresh pool, with it in *pi, or -1. */
+static double run(bool fibers, enum tpool_sched sched, bool mixed,
+                  int threads, long n, long grain, double *pi)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .sched = sched,
+                     .fibers = fibers };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    struct split all = {
+        .pool = &pool, .end = n, .grain = grain, .mixed = mixed
+    };
+    struct tpool_future *future = add_job(&pool, split_job, &all);
+    bool ok = future != NULL;
+    if (future) {
+        tpool_future_wait(future);
+        ok = future->result != NULL;
+        if (ok)
+            *pi = *(double *)future->result;
+        tpool_future_destroy(future);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    return ok ? elapsed / 1e6 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long n = 1 << 20, grain = 16;
+    const char *only = NULL;
+    while ((opt = getopt(argc, argv, "t:n:g:p:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "term count");
+            break;
+        case 'g':
+            grain = bench_arg(optarg, "grain");
+            break;
+        case 'p':
+            only = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n terms] [-g grain] "
+                    "[-p help|fibers]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (only && strcmp(only, "help") && strcmp(only, "fibers")) {
+        fprintf(stderr, "unknown pool: '%s'\n", only);
+        return EXIT_FAILURE;
+    }
+
+    static const char *const pool_names[] = { "help", "fibers" };
+    static const char *const sched_names[] = { "shared", "steal" };
+    static const char *const wait_names[] = { "future", "mixed" };
+    long jobs = split_jobs(n, grain) + 1;
+    double first = 0;
+    bool have_first = false;
+    printf("pool,sched,wait,threads,terms,jobs,ms,jobs_per_sec\n");
+    for (int fibers = 0; fibers <= 1; fibers++) {
+        if (only && strcmp(only, pool_names[fibers]))
+            continue;
+        for (int sched = TPOOL_SCHED_SHARED; sched <= TPOOL_SCHED_STEAL;
+             sched++) {
+            for (int mixed = 0; mixed <= 1; mixed++) {
+                for (int k = 1; k <= threads;
+                     k = bench_next_threads(k, threads)) {
+                    double pi = NAN;
+                    double ms = run(fibers, sched, mixed, k, n, grain, &pi);
+                    if (!have_first) {
+                        first = pi;
+                        have_first = true;
+                    }
+                    /* the terms past the first dozen are below double
+                     * precision
+                     */
+                    if (ms < 0 || isnan(pi) ||
+                        memcmp(&pi, &first, sizeof(pi)) ||
+                        (n >= 12 && fabs(pi - M_PI) > 1e-12)) {
+                        fprintf(stderr,
+                                "%s, %s, %s: failed, or pi came out "
+                                "%.17g.\n",
+                                pool_names[fibers], sched_names[sched],
+                                wait_names[mixed], pi);
+                        return EXIT_FAILURE;
+                    }
+                    printf("%s,%s,%s,%d,%ld,%ld,%.3f,%.0f\n",
+                           pool_names[fibers], sched_names[sched],
+                           wait_names[mixed], k, n, jobs, ms,
+                           jobs / ms * 1e3);
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* A pipeline of -s stages, each fanning out to -w jobs that a join job then
+ * fans back in, and -n such pipelines one after the other, two ways:
+ *
+ *     wait   the employer adds a stage, waits for it, then adds the next,
+ *            which is every hop going through a waiting thread
+ *     graph  the whole pipeline is added up front with tpool_then and
+ *            tpool_when_all, and only the last join is waited on
+ *
+ * Every job adds up its inputs, so the last join's value says whether each
+ * job ran once, after its inputs.
+ */
+
+struct node {
+    uint64_t value;
+    uint64_t add;
+    struct node **in;
+    size_t nin;
+};
+
+static void *node_job(void *arg)
+{
+    struct node *node = arg;
+    uint64_t value = node->add;
+    for (size_t i = 0; i < node->nin; i++)
+        value += node->in[i]->value;
+    node->value = value;
+    return NULL;
+}
+
+struct pipeline {
+    int stages, width;
+    struct node *work;  /* stages * width */
+    struct node *join;  /* stages */
+    struct node **in;   /* stages * width: what each join reads */
+    struct node **prev; /* stages: what each stage's jobs read */
+    struct tpool_future **futures; /* stages * (width + 1) */
+};
+
+/* One pipeline, waiting for each stage before adding the next. */
+static bool run_wait(tpool_t *pool, struct pipeline *p)
+{
+    void *args[p->width];
+    for (int s = 0; s < p->stages; s++) {
+        struct tpool_future **futures = p->futures + s * (p->width + 1);
+        for (int i = 0; i < p->width; i++)
+            args[i] = &p->work[s * p->width + i];
+        size_t added = add_jobs(pool, node_job, args, p->width, futures);
+        for (size_t i = 0; i < added; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+        }
+        if (added < (size_t)p->width)
+            return false;
+        struct tpool_future *join = add_job(pool, node_job, &p->join[s]);
+        if (!join)
+            return false;
+        tpool_future_wait(join);
+        tpool_future_destroy(join);
+    }
+    return true;
+}
+
+/* One pipeline, added as a graph and waited for at the end only. */
+static bool run_graph(tpool_t *pool, struct pipeline *p)
+{
+    size_t n = 0;
+    bool ok = true;
+    struct tpool_future *join = NULL;
+    for (int s = 0; s < p->stages && ok; s++) {
+        struct tpool_future **futures = p->futures + n;
+        for (int i = 0; i < p->width && ok; i++) {
+            struct node *work = &p->work[s * p->width + i];
+            futures[i] = join ? tpool_then(join, node_job, work)
+                              : add_job(pool, node_job, work);
+            ok = futures[i];
+            n += ok;
+        }
+        if (ok) {
+            join = tpool_when_all(pool, futures, p->width, node_job,
+                                  &p->join[s]);
+            ok = join;
+            p->futures[n] = join;
+            n += ok;
+        }
+    }
+    /* the last future is done only once all the ones before it are */
+    if (n)
+        tpool_future_wait(p->futures[n - 1]);
+    for (size_t i = 0; i < n; i++)
+        tpool_future_destroy(p->futures[i]);
+    return ok;
+}
+
+static bool pipeline_init(struct pipeline *p, int stages, int width)
+{
+    p->stages = stages;
+    p->width = width;
+    p->work = malloc(sizeof(*p->work) * stages * width);
+    p->join = malloc(sizeof(*p->join) * stages);
+    p->in = malloc(sizeof(*p->in) * stages * width);
+    p->prev = malloc(sizeof(*p->prev) * stages);
+    p->futures = malloc(sizeof(*p->futures) * stages * (width + 1));
+    if (!p->work || !p->join || !p->in || !p->prev || !p->futures)
+        return false;
+    for (int s = 0; s < stages; s++) {
+        p->prev[s] = s ? &p->join[s - 1] : NULL;
+        for (int i = 0; i < width; i++) {
+            p->work[s * width + i] = (struct node){ .add = i + 1,
+                                                    .in = &p->prev[s],
+                                                    .nin = s ? 1 : 0 };
+            p->in[s * width + i] = &p->work[s * width + i];
+        }
+        p->join[s] = (struct node){ .in = &p->in[s * width], .nin = width };
+    }
+    return true;
+}
+
+static void pipeline_destroy(struct pipeline *p)
+{
+    free(p->futures);
+    free(p->prev);
+    free(p->in);
+    free(p->join);
+    free(p->work);
+}
+
+/* What the last join has to come to. */
+static uint64_t expected(int stages, int width)
+{
+    uint64_t join = 0;
+    for (int s = 0; s < stages; s++)
+        join = width * join + (uint64_t)width * (width + 1) / 2;
+    return join;
+}
+
+/* Microseconds per pipeline on a fresh pool, or -1. */
+static double run(bool graph, enum tpool_sched sched, int threads,
+                  int pipelines, struct pipeline *p)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .sched = sched };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    bool ok = true;
+    for (int i = 0; i < pipelines && ok; i++) {
+        p->join[p->stages - 1].value = 0;
+        ok = graph ? run_graph(&pool, p) : run_wait(&pool, p);
+        ok = ok && p->join[p->stages - 1].value ==
+                       expected(p->stages, p->width);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    return ok ? elapsed / 1e3 / pipelines : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), pipelines = 2000, stages = 8, width = 8;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:s:w:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            pipelines = bench_arg(optarg, "pipeline count");
+            break;
+        case 's':
+            stages = bench_arg(optarg, "stage count");
+            break;
+        case 'w':
+            width = bench_arg(optarg, "width");
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n pipelines] [-s stages] "
+                    "[-w width]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct pipeline p;
+    if (!pipeline_init(&p, stages, width)) {
+        pipeline_destroy(&p);
+        return EXIT_FAILURE;
+    }
+    static const char *const sched_names[] = { "shared", "steal" };
+    printf("method,sched,threads,stages,width,pipelines,us_per_pipeline\n");
+    for (int graph = 0; graph < 2; graph++) {
+        for (int sched = TPOOL_SCHED_SHARED; sched <= TPOOL_SCHED_STEAL;
+             sched++) {
+            for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+                double us = run(graph, sched, t, pipelines, &p);
+                if (us < 0) {
+                    fprintf(stderr, "a pipeline went wrong.\n");
+                    pipeline_destroy(&p);
+                    return EXIT_FAILURE;
+                }
+                printf("%s,%s,%d,%d,%d,%d,%.2f\n", graph ? "graph" : "wait",
+                       sched_names[sched], t, stages, width, pipelines, us);
+            }
+        }
+    }
+    pipeline_destroy(&p);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "spinlock.h"
+
+/* Threads take turns in one critical section until -n sections per thread
+ * have run between them, under each lock of tpool/spinlock.h and under the
+ * C11 mutex for reference. A section bumps the shared count and writes to -w
+ * other shared cache lines, about what popping a job off a locked queue does.
+ *
+ * Throughput is sections per second over all threads. Fairness is Jain's
+ * index of how many sections each thread got, 1 when all got the same and
+ * 1/threads when one got them all; min_share is the thread that got the
+ * fewest, against an even share.
+ */
+
+enum lock_kind { LOCK_MUTEX, LOCK_TAS, LOCK_TTAS, LOCK_TICKET, LOCK_MCS,
+                 LOCK_CLH, LOCK_KINDS };
+
+static const char *const lock_names[] = { "mutex", "tas",  "ttas",
+                                          "ticket", "mcs", "clh" };
+
+struct shared {
+    enum lock_kind kind;
+    union {
+        mtx_t mtx;
+        struct tas_lock tas;
+        struct ttas_lock ttas;
+        struct ticket_lock ticket;
+        struct mcs_lock mcs;
+        struct clh_lock clh;
+    };
+    _Alignas(CACHE_LINE_SIZE) long count; /* under the lock */
+    long total;
+    int lines;
+    unsigned char (*data)[CACHE_LINE_SIZE]; /* lines, under the lock */
+    atomic_int ready;
+    atomic_bool go;
+};
+
+struct thread {
+    _Alignas(CACHE_LINE_SIZE) struct shared *s;
+    long sections;
+    struct mcs_node mcs;
+    struct clh_handle clh;
+};
+
+static void lock(struct shared *s, struct thread *t)
+{
+    switch (s->kind) {
+    case LOCK_MUTEX:
+        mtx_lock(&s->mtx);
+        break;
+    case LOCK_TAS:
+        tas_acquire(&s->tas);
+        break;
+    case LOCK_TTAS:
+        ttas_acquire(&s->ttas);
+        break;
+    case LOCK_TICKET:
+        ticket_acquire(&s->ticket);
+        break;
+    case LOCK_MCS:
+        mcs_acquire(&s->mcs, &t->mcs);
+        break;
+    case LOCK_CLH:
+        clh_acquire(&s->clh, &t->clh);
+        break;
+    default:
+        break;
+    }
+}
+
+static void unlock(struct shared *s, struct thread *t)
+{
+    switch (s->kind) {
+    case LOCK_MUTEX:
+        mtx_unlock(&s->mtx);
+        break;
+    case LOCK_TAS:
+        tas_release(&s->tas);
+        break;
+    case LOCK_TTAS:
+        ttas_release(&s->ttas);
+        break;
+    case LOCK_TICKET:
+        ticket_release(&s->ticket);
+        break;
+    case LOCK_MCS:
+        mcs_release(&s->mcs, &t->mcs);
+        break;
+    case LOCK_CLH:
+        clh_release(&t->clh);
+        break;
+    default:
+        break;
+    }
+}
+
+static int contend(void *arg)
+{
+    struct thread *t = arg;
+    struct shared *s = t->s;
+    atomic_fetch_add(&s->ready, 1);
+    while (!atomic_load_explicit(&s->go, memory_order_acquire))
+        thrd_yield();
+    while (1) {
+        lock(s, t);
+        if (s->count == s->total) {
+            unlock(s, t);
+            return 0;
+        }
+        s->count++;
+        for (int i = 0; i < s->lines; i++)
+            s->data[i][0]++;
+        unlock(s, t);
+        t->sections++;
+    }
+}
+
+static bool shared_init(struct shared *s, enum lock_kind kind)
+{
+    s->kind = kind;
+    switch (kind) {
+    case LOCK_MUTEX:
+        return mtx_init(&s->mtx, mtx_plain) == thrd_success;
+    case LOCK_TAS:
+        tas_init(&s->tas);
+        return true;
+    case LOCK_TTAS:
+        ttas_init(&s->ttas);
+        return true;
+    case LOCK_TICKET:
+        ticket_init(&s->ticket);
+        return true;
+    case LOCK_MCS:
+        mcs_init(&s->mcs);
+        return true;
+    case LOCK_CLH:
+        return clh_init(&s->clh);
+    default:
+        return false;
+    }
+}
+
+static void shared_destroy(struct shared *s)
+{
+    if (s->kind == LOCK_MUTEX)
+        mtx_destroy(&s->mtx);
+    else if (s->kind == LOCK_CLH)
+        clh_destroy(&s->clh);
+}
+
+/* Milliseconds for n sections per thread under the lock, or -1. */
+static double run(struct shared *s, struct thread *threads, thrd_t *ids,
+                  int n_threads, long n)
+{
+    s->count = 0;
+    s->total = n * n_threads;
+    atomic_init(&s->ready, 0);
+    atomic_init(&s->go, false);
+    int started = 0;
+    for (; started < n_threads; started++) {
+        struct thread *t = &threads[started];
+        t->s = s;
+        t->sections = 0;
+        if (s->kind == LOCK_CLH && !clh_handle_init(&t->clh))
+            break;
+        if (thrd_create(&ids[started], contend, t) != thrd_success) {
+            if (s->kind == LOCK_CLH)
+                clh_handle_destroy(&t->clh);
+            break;
+        }
+    }
+    /* threads that did start still need a go to return */
+    bool ok = started == n_threads;
+    if (!ok)
+        s->total = 0;
+    while (atomic_load(&s->ready) < started)
+        thrd_yield();
+    uint64_t start = bench_now_ns();
+    atomic_store_explicit(&s->go, true, memory_order_release);
+    for (int i = 0; i < started; i++)
+        thrd_join(ids[i], NULL);
+    uint64_t elapsed = bench_now_ns() - start;
+    if (s->kind == LOCK_CLH) {
+        for (int i = 0; i < started; i++)
+            clh_handle_destroy(&threads[i].clh);
+    }
+    return ok && s->count == s->total ? elapsed / 1e6 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), lines = 1, opt;
+    long n = 100000;
+    while ((opt = getopt(argc, argv, "t:n:w:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "section count");
+            break;
+        case 'w':
+            lines = bench_arg(optarg, "line count");
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n sections] [-w lines]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct shared *s = aligned_alloc(_Alignof(struct shared), sizeof(*s));
+    struct thread *t = aligned_alloc(_Alignof(struct thread),
+                                     sizeof(*t) * threads);
+    thrd_t *ids = malloc(sizeof(*ids) * threads);
+    void *data = calloc(lines, CACHE_LINE_SIZE);
+    if (!s || !t || !ids || !data)
+        return EXIT_FAILURE;
+    s->lines = lines;
+    s->data = data;
+
+    printf("lock,threads,sections,ms,sections_per_sec,fairness,min_share\n");
+    for (int kind = 0; kind < LOCK_KINDS; kind++) {
+        for (int k = 1; k <= threads; k = bench_next_threads(k, threads)) {
+            if (!shared_init(s, kind))
+                return EXIT_FAILURE;
+            double ms = run(s, t, ids, k, n);
+            shared_destroy(s);
+            if (ms < 0) {
+                fprintf(stderr, "%s lost a section.\n", lock_names[kind]);
+                return EXIT_FAILURE;
+            }
+            double sum = 0, squares = 0;
+            long fewest = t[0].sections;
+            for (int i = 0; i < k; i++) {
+                sum += t[i].sections;
+                squares += (double)t[i].sections * t[i].sections;
+                if (t[i].sections < fewest)
+                    fewest = t[i].sections;
+            }
+            printf("%s,%d,%ld,%.3f,%.0f,%.3f,%.3f\n", lock_names[kind], k,
+                   n * k, ms, n * k / ms * 1e3, sum * sum / (k * squares),
+                   fewest / (sum / k));
+        }
+    }
+    free(data);
+    free(ids);
+    free(t);
+    free(s);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* -n parent jobs, each filling a buffer of its own and then fanning out to -f
+ * children that add up a slice of it apiece. Every child notes whether it ran
+ * on the node its parent added it from, which is the node whose memory the
+ * buffer was first touched on. The pool is split into one node and into two,
+ * made up with the "nodes" option so that the split runs on any machine, with
+ * and without pinning the workers. On a machine with one real node the two
+ * made-up ones share its memory, so there the time shows the cost of the
+ * bookkeeping and local_pct how well the scheduler keeps to a node.
+ */
+
+struct child {
+    tpool_t *pool;
+    const unsigned int *slice;
+    size_t len;
+    int node;    /* the parent's */
+    bool local;  /* ran on it */
+    uint64_t sum;
+};
+
+struct parent {
+    tpool_t *pool;
+    int fanout;
+    size_t len; /* of each child's slice */
+    size_t local;
+    bool ok;
+};
+
+static void *child_job(void *arg)
+{
+    struct child *c = arg;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < c->len; i++)
+        sum += c->slice[i];
+    c->sum = sum;
+    c->local = tpool_current_node(c->pool) == c->node;
+    return NULL;
+}
+
+static void *parent_job(void *arg)
+{
+    struct parent *p = arg;
+    size_t n = p->len * p->fanout;
+    unsigned int *buf = malloc(sizeof(*buf) * n);
+    struct child *children = malloc(sizeof(*children) * p->fanout);
+    void **args = malloc(sizeof(*args) * p->fanout);
+    struct tpool_future **futures = malloc(sizeof(*futures) * p->fanout);
+    p->ok = false;
+    p->local = 0;
+    if (buf && children && args && futures) {
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (unsigned int)i;
+        int node = tpool_current_node(p->pool);
+        for (int i = 0; i < p->fanout; i++) {
+            children[i] = (struct child){ .pool = p->pool,
+                                          .slice = buf + i * p->len,
+                                          .len = p->len,
+                                          .node = node };
+            args[i] = &children[i];
+        }
+        size_t added =
+            add_jobs(p->pool, child_job, args, p->fanout, futures);
+        uint64_t sum = 0;
+        for (size_t i = 0; i < added; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+            sum += children[i].sum;
+            p->local += children[i].local;
+        }
+        p->ok = added == (size_t)p->fanout &&
+                sum == (uint64_t)n * (n - 1) / 2;
+    }
+    free(futures);
+    free(args);
+    free(children);
+    free(buf);
+    return NULL;
+}
+
+/* Milliseconds for every parent on a fresh pool, or -1. */
+static double run(int nodes, bool pin, int threads, struct parent *parents,
+                  int n, int fanout, size_t len, double *local_pct)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .sched = TPOOL_SCHED_STEAL,
+                     .nodes = nodes,
+                     .pin = pin };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+
+    void **args = malloc(sizeof(*args) * n);
+    struct tpool_future **futures = malloc(sizeof(*futures) * n);
+    if (!args || !futures) {
+        free(futures);
+        free(args);
+        tpool_destroy(&pool);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        parents[i] = (struct parent){ .pool = &pool,
+                                      .fanout = fanout,
+                                      .len = len };
+        args[i] = &parents[i];
+    }
+    uint64_t start = bench_now_ns();
+    size_t added = add_jobs(&pool, parent_job, args, n, futures);
+    for (size_t i = 0; i < added; i++) {
+        tpool_future_wait(futures[i]);
+        tpool_future_destroy(futures[i]);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    free(futures);
+    free(args);
+
+    bool ok = added == (size_t)n;
+    size_t local = 0;
+    for (int i = 0; i < n && ok; i++) {
+        ok = parents[i].ok;
+        local += parents[i].local;
+    }
+    *local_pct = 100.0 * local / ((double)n * fanout);
+    return ok ? elapsed / 1e6 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), n = 2000, fanout = 8, opt;
+    long len = 4096;
+    while ((opt = getopt(argc, argv, "t:n:f:l:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "job count");
+            break;
+        case 'f':
+            fanout = bench_arg(optarg, "fanout");
+            break;
+        case 'l':
+            len = bench_arg(optarg, "slice length");
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n jobs] [-f fanout] "
+                    "[-l slice]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct parent *parents = malloc(sizeof(*parents) * n);
+    if (!parents)
+        return EXIT_FAILURE;
+    printf("nodes,pin,threads,jobs,fanout,ms,jobs_per_sec,local_pct\n");
+    for (int nodes = 1; nodes <= 2; nodes++) {
+        for (int pin = 0; pin < 2; pin++) {
+            for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+                double local_pct;
+                double ms = run(nodes, pin, t, parents, n, fanout, len,
+                                &local_pct);
+                if (ms < 0) {
+                    fprintf(stderr, "a sum came out wrong.\n");
+                    free(parents);
+                    return EXIT_FAILURE;
+                }
+                double jobs = (double)n * (fanout + 1);
+                printf("%d,%d,%d,%d,%d,%.3f,%.0f,%.1f\n", nodes, pin, t, n,
+                       fanout, ms, jobs / ms * 1e3, local_pct);
+            }
+        }
+    }
+    free(parents);
+    return EXIT_SUCCESS;
+}
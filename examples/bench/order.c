@@ -0,0 +1,169 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* The pool's hot paths, for comparing memory orders. The Makefile builds
+ * this twice: bench/order against the library as it is, with the weakest
+ * orders that are correct, and bench/order-sc against the same library built
+ * with TPOOL_SEQ_CST, where every atomic is sequentially consistent. The
+ * "order" column says which one ran.
+ *
+ * x86 orders every store and load anyway, so there the two builds differ
+ * only by the odd fence. The difference shows on weakly ordered machines such
+ * as ARM64 or POWER, where each seq_cst poll is a barrier.
+ */
+
+#define CUTOFF 12
+
+static tpool_t *fib_pool;
+
+static void *nop(void *arg)
+{
+    return arg;
+}
+
+static long fib_serial(int n)
+{
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static void *fib_job(void *arg);
+
+static long fib(long n)
+{
+    if (n < CUTOFF)
+        return fib_serial(n);
+    struct tpool_future *future =
+        add_job(fib_pool, fib_job, (void *)(n - 1));
+    long right = fib(n - 2), left;
+    if (future) {
+        tpool_future_wait(future);
+        left = *(long *)future->result;
+        tpool_future_destroy(future);
+    } else {
+        left = fib(n - 1);
+    }
+    return left + right;
+}
+
+/* the result fits in the future: no allocation per job */
+static void *fib_job(void *arg)
+{
+    long *result = tpool_result_alloc(sizeof(*result));
+    if (result)
+        *result = fib((long)arg);
+    return result;
+}
+
+static void report(const char *test, int threads, int ops, uint64_t ns)
+{
+    printf("%s,%s,%d,%d,%.1f\n", TPOOL_ORDER, test, threads, ops,
+           (double)ns / ops);
+}
+
+/* one job at a time, there and back: the latency of the hand-offs */
+static int run_pingpong(tpool_t *pool, int threads, int jobs)
+{
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < jobs; i++) {
+        struct tpool_future *future = add_job(pool, nop, NULL);
+        if (!future)
+            return -1;
+        tpool_future_wait(future);
+        tpool_future_destroy(future);
+    }
+    report("pingpong", threads, jobs, bench_now_ns() - start);
+    return 0;
+}
+
+/* bursts through the shared ring: its slots and indices */
+static int run_burst(tpool_t *pool, int threads, int jobs)
+{
+    enum { BURST = 256 };
+    struct tpool_future *futures[BURST];
+    void *args[BURST] = { 0 };
+    uint64_t start = bench_now_ns();
+    for (int done = 0; done < jobs; done += BURST) {
+        int n = jobs - done < BURST ? jobs - done : BURST;
+        if ((int)add_jobs(pool, nop, args, n, futures) != n)
+            return -1;
+        for (int i = 0; i < n; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+        }
+    }
+    report("burst", threads, jobs, bench_now_ns() - start);
+    return 0;
+}
+
+/* recursive spawning: the deques and stealing */
+static int run_spawn(int threads, int n)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .sched = TPOOL_SCHED_STEAL };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    fib_pool = &pool;
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    struct tpool_future *future = add_job(&pool, fib_job, (void *)(long)n);
+    long result = -1;
+    if (future) {
+        tpool_future_wait(future);
+        if (future->result)
+            result = *(long *)future->result;
+        tpool_future_destroy(future);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    if (result != fib_serial(n)) {
+        fprintf(stderr, "fib(%d) came out wrong.\n", n);
+        return -1;
+    }
+    /* per spawned job: fib(n) spawns about fib(n - CUTOFF + 2) of them */
+    long jobs = n < CUTOFF ? 1 : fib_serial(n - CUTOFF + 2);
+    report("spawn", threads, (int)jobs, elapsed);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), jobs = 200000, opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            jobs = bench_arg(optarg, "job count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n jobs]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    if (!tpool_init(&pool, threads))
+        return EXIT_FAILURE;
+    tpool_run(&pool);
+    printf("order,test,threads,ops,ns_per_op\n");
+    /* a round trip costs far more than a job in a burst: run fewer */
+    int failed = run_pingpong(&pool, threads, jobs / 10 ? jobs / 10 : 1) ||
+                 run_burst(&pool, threads, jobs);
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+
+    /* about as many spawned jobs as the other tests run */
+    int n = CUTOFF;
+    while (n < 40 && fib_serial(n - CUTOFF + 3) <= jobs)
+        n++;
+    if (failed || run_spawn(threads, n))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbp.h"
+#include "bench.h"
+#include "tpool.h"
+
+/* Hex digits of pi from position -s on, -n of them, by BBP digit extraction:
+ * one job per block of BBP_HEX_BLOCK digits, independent of all the others,
+ * and costing more the further out it is. That makes a CPU-bound workload of
+ * any size, from the single block "-s 999999 -n 8" to millions of jobs.
+ *
+ * Whatever part of the range has known digits, below, is checked against
+ * them, and a mismatch fails the run.
+ */
+
+/* The first digits, computed independently with Machin's formula. */
+static const char pi_hex[] =
+    "243F6A8885A308D313198A2E03707344A4093822299F31D0082EFA98EC4E6C89"
+    "452821E638D01377BE5466CF34E90C6CC0AC29B7C97C50DD3F84D5B5B5470917"
+    "9216D5D98979FB1BD1310BA698DFB5AC2FFD72DBD01ADFB7B8E1AFED6A267E96"
+    "BA7C9045F12C7F9924A19947B3916CF70801F2E2858EFC16636920D871574E69";
+
+/* Digits far out, as published by Bailey, Borwein and Plouffe in "On the
+ * rapid computation of various polylogarithmic constants" (1997), which
+ * counts positions from 1.
+ */
+static const struct {
+    long position;
+    const char *digits;
+} known[] = {
+    { 0, pi_hex },
+    { 1000000 - 1, "26C65E52CB4593" },
+    { 10000000 - 1, "17AF5863EFED8D" },
+};
+
+struct block {
+    long position;
+    uint32_t *digits;
+};
+
+static void *block_job(void *arg)
+{
+    struct block *block = arg;
+    *block->digits = bbp_hex_digits(block->position);
+    return NULL;
+}
+
+/* the digit at position p of a range that starts at start */
+static int digit_at(const uint32_t *digits, long start, long p)
+{
+    long i = p - start;
+    int shift = 4 * (BBP_HEX_BLOCK - 1 - i % BBP_HEX_BLOCK);
+    return digits[i / BBP_HEX_BLOCK] >> shift & 0xf;
+}
+
+/* Digits compared with known ones, or -1 after reporting a mismatch. */
+static long check(const uint32_t *digits, long start, long n)
+{
+    long checked = 0;
+    for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++) {
+        long len = strlen(known[k].digits);
+        for (long i = 0; i < len; i++) {
+            long p = known[k].position + i;
+            if (p < start || p >= start + n)
+                continue;
+            char want = known[k].digits[i];
+            char got = "0123456789ABCDEF"[digit_at(digits, start, p)];
+            if (got != want) {
+                fprintf(stderr, "digit %ld came out %c, not %c.\n", p, got,
+                        want);
+                return -1;
+            }
+            checked++;
+        }
+    }
+    return checked;
+}
+
+/* Milliseconds to compute the range on a fresh pool, or -1. */
+static double run(int threads, long start, long n, uint32_t *digits)
+{
+    long jobs = (n + BBP_HEX_BLOCK - 1) / BBP_HEX_BLOCK;
+    struct block *blocks = malloc(sizeof(*blocks) * jobs);
+    void **args = malloc(sizeof(*args) * jobs);
+    struct tpool_future **futures = malloc(sizeof(*futures) * jobs);
+    struct tpool_batch *batch = tpool_batch_create(jobs);
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    double ms = -1;
+    if (!blocks || !args || !futures || !batch ||
+        !tpool_init(&pool, threads))
+        goto out;
+    for (long i = 0; i < jobs; i++) {
+        blocks[i] = (struct block){ .position = start + i * BBP_HEX_BLOCK,
+                                    .digits = &digits[i] };
+        args[i] = &blocks[i];
+    }
+    tpool_run(&pool);
+
+    uint64_t begin = bench_now_ns();
+    size_t added =
+        tpool_batch_add(&pool, batch, block_job, args, jobs, futures);
+    tpool_batch_wait(batch);
+    uint64_t elapsed = bench_now_ns() - begin;
+    for (size_t i = 0; i < added; i++)
+        tpool_future_destroy(futures[i]);
+    if (added == (size_t)jobs)
+        ms = elapsed / 1e6;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+out:
+    tpool_batch_destroy(batch);
+    free(futures);
+    free(args);
+    free(blocks);
+    return ms;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long start = 0, n = 4096;
+    while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "digit count");
+            break;
+        case 's':
+            /* 0 is a position too, which bench_arg would refuse */
+            start = strcmp(optarg, "0") ? bench_arg(optarg, "position") : 0;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n digits] [-s start]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (start + n + BBP_HEX_BLOCK > BBP_HEX_MAX) {
+        fprintf(stderr, "positions past %ld are out of reach.\n",
+                BBP_HEX_MAX);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t *digits =
+        malloc(sizeof(*digits) * ((n + BBP_HEX_BLOCK - 1) / BBP_HEX_BLOCK));
+    if (!digits)
+        return EXIT_FAILURE;
+    printf("threads,start,digits,ms,digits_per_sec,checked,first\n");
+    for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+        double ms = run(t, start, n, digits);
+        long checked = ms < 0 ? -1 : check(digits, start, n);
+        if (checked < 0) {
+            free(digits);
+            return EXIT_FAILURE;
+        }
+        char first[17];
+        int len = n < 16 ? (int)n : 16;
+        for (int i = 0; i < len; i++)
+            first[i] = "0123456789ABCDEF"[digit_at(digits, start, start + i)];
+        first[len] = '\0';
+        printf("%d,%ld,%ld,%.3f,%.0f,%ld,%s\n", t, start, n, ms,
+               n / (ms / 1e3), checked, first);
+    }
+    free(digits);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#ifndef BENCH_POOLS_H
+#define BENCH_POOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+/* The job bench/suite runs on every pool: spin for a given time, then note
+ * when it finished. Whoever submits it notes when it was submitted, which
+ * gives each job's submit-to-complete latency without the pool under test
+ * having to report anything.
+ */
+struct bench_job {
+    uint64_t submitted;
+    uint64_t done;
+    uint64_t work_ns;
+};
+
+static inline void *bench_job_run(void *arg)
+{
+    struct bench_job *job = arg;
+    if (job->work_ns) {
+        uint64_t start = bench_now_ns();
+        while (bench_now_ns() - start < job->work_ns)
+            ;
+    }
+    job->done = bench_now_ns();
+    return NULL;
+}
+
+/* The pools of rmw_example.c and rmw_example_aba.c, as printed in the book.
+ * They only take jobs while idle, so all they can run is a burst: n jobs
+ * added to a fresh pool of the given size, which is then set running and
+ * waited on. Returns 0 with the time from the first submission to the last
+ * completion in *elapsed, or -1 if the pool failed; setting up and tearing
+ * down the pool is not counted.
+ */
+int book_rmw_burst(int threads, struct bench_job *jobs, size_t n,
+                   uint64_t *elapsed);
+int book_aba_burst(int threads, struct bench_job *jobs, size_t n,
+                   uint64_t *elapsed);
+
+#endif
@@ -0,0 +1,117 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "pools.h"
+#include "tpool.h"
+
+/* A flood of -n bulk jobs of -w nanoseconds each, added as fast as the pool
+ * takes them, with an empty urgent job slipped in after every -i of them. The
+ * urgent jobs go in with tpool_add_priority at level 0, on a pool with one
+ * level, where that is the bulk's level too, and on one with two. Their
+ * latency is the time from being added to being done: behind the bulk, that
+ * is however long the queue ahead of them takes to drain.
+ */
+
+/* After every interval bulk jobs, an urgent one. */
+static bool is_urgent(size_t i, size_t interval)
+{
+    return (i + 1) % (interval + 1) == 0;
+}
+
+/* Milliseconds for the whole flood on a fresh pool, or -1. */
+static double run(int levels, int threads, struct bench_job *jobs, size_t n,
+                  size_t interval, struct tpool_future **futures)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .priorities = levels };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    size_t added = 0;
+    for (; added < n; added++) {
+        int priority = is_urgent(added, interval) ? 0 : 1;
+        jobs[added].submitted = bench_now_ns();
+        futures[added] =
+            tpool_add_priority(&pool, priority, bench_job_run, &jobs[added]);
+        if (!futures[added])
+            break;
+    }
+    for (size_t i = 0; i < added; i++) {
+        tpool_future_wait(futures[i]);
+        tpool_future_destroy(futures[i]);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    return added == n ? elapsed / 1e6 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long bulk = 20000, work = 10000, interval = 100;
+    while ((opt = getopt(argc, argv, "t:n:w:i:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            bulk = bench_arg(optarg, "job count");
+            break;
+        case 'w':
+            work = bench_arg(optarg, "job size");
+            break;
+        case 'i':
+            interval = bench_arg(optarg, "interval");
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n jobs] [-w ns] [-i interval]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* which makes every (interval + 1)-th job of n an urgent one */
+    size_t urgent = bulk / interval, n = bulk + urgent;
+    struct bench_job *jobs = malloc(sizeof(*jobs) * n);
+    struct tpool_future **futures = malloc(sizeof(*futures) * n);
+    uint64_t *latency = malloc(sizeof(*latency) * n);
+    if (!jobs || !futures || !latency)
+        return EXIT_FAILURE;
+
+    printf("levels,threads,bulk_jobs,bulk_ns,urgent_jobs,ms,urgent_p50_ns,"
+           "urgent_p99_ns,bulk_p50_ns\n");
+    for (int levels = 1; levels <= 2; levels++) {
+        for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+            for (size_t i = 0; i < n; i++) {
+                uint64_t ns = is_urgent(i, interval) ? 0 : work;
+                jobs[i] = (struct bench_job){ .work_ns = ns };
+            }
+            double ms = run(levels, t, jobs, n, interval, futures);
+            if (ms < 0) {
+                fprintf(stderr, "the pool failed.\n");
+                return EXIT_FAILURE;
+            }
+            /* urgent latencies first, then the bulk's */
+            size_t u = 0, b = urgent;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t l = jobs[i].done - jobs[i].submitted;
+                latency[is_urgent(i, interval) ? u++ : b++] = l;
+            }
+            printf("%d,%d,%ld,%ld,%zu,%.3f,%llu,%llu,%llu\n", levels, t, bulk,
+                   work, urgent, ms,
+                   (unsigned long long)bench_percentile(latency, u, 50),
+                   (unsigned long long)bench_percentile(latency, u, 99),
+                   (unsigned long long)bench_percentile(latency + urgent,
+                                                        b - urgent, 50));
+        }
+    }
+    free(latency);
+    free(futures);
+    free(jobs);
+    return EXIT_SUCCESS;
+}
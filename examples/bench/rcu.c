@@ -0,0 +1,242 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "qsbr.h"
+
+/* -t readers, 64 by default as N_THREADS in the book's listing, each read a
+ * small configuration -n times while a writer replaces it every -w
+ * microseconds, two ways:
+ *
+ *     qsbr    behind a pointer under tpool/qsbr.h, the way the pool's workers
+ *             read theirs: a reader reports a quiescent state after each
+ *             read, as a worker does after each job
+ *     rwlock  in place under a pthread_rwlock_t, which every reader takes
+ *             for reading and so writes to, on the same line as all others
+ *
+ * Every field of a configuration holds its version, so a reader that sees
+ * two different ones has read a copy half written, and the run fails. Reads
+ * per second are over all readers; writes is how many times the writer got
+ * to replace the configuration meanwhile.
+ */
+
+#define FIELDS 8
+
+struct config {
+    struct qsbr_node node;
+    long field[FIELDS];
+};
+
+enum method { METHOD_QSBR, METHOD_RWLOCK, METHODS };
+
+static const char *const method_names[] = { "qsbr", "rwlock" };
+
+struct shared {
+    enum method method;
+    long reads; /* per reader */
+    uint64_t period_ns;
+    struct qsbr qsbr;
+    _Atomic(struct config *) config; /* qsbr */
+    pthread_rwlock_t rwlock;
+    struct config locked; /* rwlock */
+    atomic_int ready;
+    atomic_bool go;
+    atomic_bool stop;
+    atomic_bool torn;
+    long writes;
+};
+
+struct reader {
+    struct shared *s;
+    int index;
+};
+
+static bool consistent(const struct config *c)
+{
+    for (int i = 1; i < FIELDS; i++) {
+        if (c->field[i] != c->field[0])
+            return false;
+    }
+    return true;
+}
+
+static void fill(struct config *c, long version)
+{
+    for (int i = 0; i < FIELDS; i++)
+        c->field[i] = version;
+}
+
+static int read_config(void *arg)
+{
+    struct reader *r = arg;
+    struct shared *s = r->s;
+    bool ok = true;
+    atomic_fetch_add(&s->ready, 1);
+    while (!atomic_load_explicit(&s->go, memory_order_acquire))
+        thrd_yield();
+    if (s->method == METHOD_QSBR) {
+        qsbr_online(&s->qsbr, r->index);
+        for (long i = 0; i < s->reads && ok; i++) {
+            ok = consistent(qsbr_read(&s->config));
+            qsbr_quiescent(&s->qsbr, r->index);
+        }
+        qsbr_offline(&s->qsbr, r->index);
+    } else {
+        for (long i = 0; i < s->reads && ok; i++) {
+            pthread_rwlock_rdlock(&s->rwlock);
+            ok = consistent(&s->locked);
+            pthread_rwlock_unlock(&s->rwlock);
+        }
+    }
+    if (!ok)
+        atomic_store(&s->torn, true);
+    return 0;
+}
+
+static void config_free(struct qsbr_node *node)
+{
+    free((struct config *)node);
+}
+
+static int write_config(void *arg)
+{
+    struct shared *s = arg;
+    long version = 0;
+    while (!atomic_load(&s->stop)) {
+        bench_sleep_ns(s->period_ns);
+        version++;
+        if (s->method == METHOD_QSBR) {
+            struct config *c = malloc(sizeof(*c));
+            if (!c)
+                break;
+            fill(c, version);
+            struct config *old = atomic_load_explicit(&s->config,
+                                                      memory_order_relaxed);
+            qsbr_publish(&s->config, c);
+            qsbr_retire(&s->qsbr, &old->node, config_free);
+            qsbr_reclaim(&s->qsbr);
+        } else {
+            pthread_rwlock_wrlock(&s->rwlock);
+            fill(&s->locked, version);
+            pthread_rwlock_unlock(&s->rwlock);
+        }
+    }
+    s->writes = version;
+    return 0;
+}
+
+static bool shared_init(struct shared *s, int readers)
+{
+    if (s->method == METHOD_RWLOCK) {
+        fill(&s->locked, 0);
+        return pthread_rwlock_init(&s->rwlock, NULL) == 0;
+    }
+    struct config *c = malloc(sizeof(*c));
+    if (!c)
+        return false;
+    if (!qsbr_init(&s->qsbr, readers)) {
+        free(c);
+        return false;
+    }
+    fill(c, 0);
+    atomic_init(&s->config, c);
+    return true;
+}
+
+static void shared_destroy(struct shared *s)
+{
+    if (s->method == METHOD_RWLOCK) {
+        pthread_rwlock_destroy(&s->rwlock);
+        return;
+    }
+    /* the readers are all gone: whatever is retired can go */
+    qsbr_destroy(&s->qsbr);
+    free(atomic_load(&s->config));
+}
+
+/* Milliseconds until every reader is done, or -1. */
+static double run(struct shared *s, struct reader *readers, thrd_t *ids,
+                  int n_readers)
+{
+    atomic_init(&s->ready, 0);
+    atomic_init(&s->go, false);
+    atomic_init(&s->stop, false);
+    atomic_init(&s->torn, false);
+    thrd_t writer;
+    if (thrd_create(&writer, write_config, s) != thrd_success)
+        return -1;
+    int started = 0;
+    for (; started < n_readers; started++) {
+        readers[started] = (struct reader){ .s = s, .index = started };
+        if (thrd_create(&ids[started], read_config, &readers[started]) !=
+            thrd_success)
+            break;
+    }
+    while (atomic_load(&s->ready) < started)
+        thrd_yield();
+    uint64_t start = bench_now_ns();
+    atomic_store_explicit(&s->go, true, memory_order_release);
+    for (int i = 0; i < started; i++)
+        thrd_join(ids[i], NULL);
+    uint64_t elapsed = bench_now_ns() - start;
+    atomic_store(&s->stop, true);
+    thrd_join(writer, NULL);
+    if (started < n_readers || atomic_load(&s->torn))
+        return -1;
+    return elapsed / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 64, opt;
+    long reads = 1000000, period_us = 100;
+    while ((opt = getopt(argc, argv, "t:n:w:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "reader count");
+            break;
+        case 'n':
+            reads = bench_arg(optarg, "read count");
+            break;
+        case 'w':
+            period_us = bench_arg(optarg, "write period");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t readers] [-n reads] [-w us]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct shared *s = aligned_alloc(_Alignof(struct shared), sizeof(*s));
+    struct reader *readers = malloc(sizeof(*readers) * threads);
+    thrd_t *ids = malloc(sizeof(*ids) * threads);
+    if (!s || !readers || !ids)
+        return EXIT_FAILURE;
+    s->reads = reads;
+    s->period_ns = (uint64_t)period_us * 1000;
+
+    printf("method,readers,reads,ms,reads_per_sec,writes\n");
+    for (int m = 0; m < METHODS; m++) {
+        s->method = m;
+        for (int k = 1; k <= threads; k = bench_next_threads(k, threads)) {
+            if (!shared_init(s, k))
+                return EXIT_FAILURE;
+            double ms = run(s, readers, ids, k);
+            shared_destroy(s);
+            if (ms < 0) {
+                fprintf(stderr, "%s: torn read or no threads.\n",
+                        method_names[m]);
+                return EXIT_FAILURE;
+            }
+            printf("%s,%d,%ld,%.3f,%.0f,%ld\n", method_names[m], k,
+                   reads * k, ms, reads * k / ms * 1e3, s->writes);
+        }
+    }
+    free(ids);
+    free(readers);
+    free(s);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbp.h"
+#include "bench.h"
+#include "tpool.h"
+
+/* The BBP series summed over -n terms in jobs of -g terms, two ways, with the
+ * thread count doubling up to -t:
+ *
+ *     futures  as the book's main does: one future per job, waited on in
+ *              order, with the results added up as they come
+ *     reduce   tpool_parallel_reduce, with the jobs adding up each other's
+ *              results in a tree
+ *
+ * The reduction has to come out bit for bit the same on every thread count.
+ * Before anything is timed, it also reduces the book's own 100 terms one per
+ * job and has to print exactly the line the book does.
+ */
+
+#define BOOK_TERMS 100
+#define BOOK_LINE "PI calculated with 100 terms: 3.141592653589793"
+
+static void sum_map(void *acc, size_t begin, size_t end, void *ctx)
+{
+    (void)ctx;
+    *(double *)acc += bbp_sum_scalar(begin, end);
+}
+
+static void sum_combine(void *acc, const void *other, void *ctx)
+{
+    (void)ctx;
+    *(double *)acc += *(const double *)other;
+}
+
+static const double zero = 0;
+
+static const struct tpool_reduce sum = {
+    .map = sum_map,
+    .combine = sum_combine,
+    .identity = &zero,
+    .size = sizeof(double),
+};
+
+struct chunk {
+    long begin, end;
+};
+
+static void *chunk_job(void *arg)
+{
+    struct chunk *chunk = arg;
+    double *partial = tpool_result_alloc(sizeof(double));
+    if (partial)
+        *partial = bbp_sum_scalar(chunk->begin, chunk->end);
+    return partial;
+}
+
+/* Milliseconds the sum took on a fresh pool, with it in *pi, or -1. */
+static double run(bool reduce, int threads, long n, long grain, double *pi)
+{
+    long jobs = (n + grain - 1) / grain;
+    struct chunk *chunks = malloc(sizeof(*chunks) * jobs);
+    void **args = malloc(sizeof(*args) * jobs);
+    struct tpool_future **futures = malloc(sizeof(*futures) * jobs);
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    double ms = -1;
+    if (!chunks || !args || !futures || !tpool_init(&pool, threads))
+        goto out;
+    for (long i = 0; i < jobs; i++) {
+        long end = (i + 1) * grain < n ? (i + 1) * grain : n;
+        chunks[i] = (struct chunk){ .begin = i * grain, .end = end };
+        args[i] = &chunks[i];
+    }
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    bool ok = true;
+    if (reduce) {
+        struct tpool_range range = { .end = n, .grain = grain };
+        ok = tpool_parallel_reduce(&pool, range, &sum, pi);
+    } else {
+        size_t added = add_jobs(&pool, chunk_job, args, jobs, futures);
+        *pi = 0;
+        for (size_t i = 0; i < added; i++) {
+            tpool_future_wait(futures[i]);
+            if (futures[i]->result)
+                *pi += *(double *)futures[i]->result;
+            else
+                ok = false;
+            tpool_future_destroy(futures[i]);
+        }
+        ok = ok && added == (size_t)jobs;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    if (ok)
+        ms = elapsed / 1e6;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+out:
+    free(futures);
+    free(args);
+    free(chunks);
+    return ms;
+}
+
+/* The book's terms one per job, against the line it prints. */
+static bool check_book(int threads)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    if (!tpool_init(&pool, threads))
+        return false;
+    tpool_run(&pool);
+    struct tpool_range range = { .end = BOOK_TERMS, .grain = 1 };
+    double pi;
+    bool ok = tpool_parallel_reduce(&pool, range, &sum, &pi);
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    if (!ok)
+        return false;
+
+    double serial = 0;
+    for (long k = 0; k < BOOK_TERMS; k++)
+        serial += bbp_term(k, bbp_power(k));
+    char line[64];
+    snprintf(line, sizeof(line), "PI calculated with %d terms: %.15f",
+             BOOK_TERMS, pi);
+    if (memcmp(&pi, &serial, sizeof(pi)) || strcmp(line, BOOK_LINE)) {
+        fprintf(stderr, "%d threads: '%s' (%.17g, serially %.17g)\n", threads,
+                line, pi, serial);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long n = 1 << 22, grain = 64;
+    while ((opt = getopt(argc, argv, "t:n:g:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "term count");
+            break;
+        case 'g':
+            grain = bench_arg(optarg, "grain");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n terms] [-g grain]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("method,threads,terms,grain,ms,mterms_per_sec,sum\n");
+    double first = 0;
+    for (int reduce = 0; reduce < 2; reduce++) {
+        for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+            if (reduce && !check_book(t))
+                return EXIT_FAILURE;
+            double pi;
+            double ms = run(reduce, t, n, grain, &pi);
+            if (ms < 0) {
+                fprintf(stderr, "the pool failed.\n");
+                return EXIT_FAILURE;
+            }
+            if (reduce && t == 1)
+                first = pi;
+            else if (reduce && memcmp(&pi, &first, sizeof(pi))) {
+                fprintf(stderr, "%d threads summed to %.17g, 1 to %.17g.\n",
+                        t, pi, first);
+                return EXIT_FAILURE;
+            }
+            printf("%s,%d,%ld,%ld,%.3f,%.1f,%.17g\n",
+                   reduce ? "reduce" : "futures", t, n, grain, ms,
+                   n / ms / 1e3, pi);
+        }
+    }
+    return EXIT_SUCCESS;
+}
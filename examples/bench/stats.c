@@ -0,0 +1,161 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* What the pool's counters say about a few workloads: bursts of small jobs
+ * with parked and with spinning workers, and recursive spawning with work
+ * stealing. The Makefile builds this against the library with TPOOL_STATS;
+ * the counters cost nothing in the other builds because they are not there.
+ *
+ * Histograms are reported as the upper end of the power-of-two bucket that
+ * holds the percentile, so they are good to a factor of two.
+ */
+
+#define CUTOFF 12
+
+static tpool_t *fib_pool;
+
+static void *nop(void *arg)
+{
+    return arg;
+}
+
+static long fib_serial(int n)
+{
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static void *fib_job(void *arg);
+
+static long fib(long n)
+{
+    if (n < CUTOFF)
+        return fib_serial(n);
+    struct tpool_future *future =
+        add_job(fib_pool, fib_job, (void *)(n - 1));
+    long right = fib(n - 2), left;
+    if (future) {
+        tpool_future_wait(future);
+        left = *(long *)future->result;
+        tpool_future_destroy(future);
+    } else {
+        left = fib(n - 1);
+    }
+    return left + right;
+}
+
+static void *fib_job(void *arg)
+{
+    long *result = tpool_result_alloc(sizeof(*result));
+    if (result)
+        *result = fib((long)arg);
+    return result;
+}
+
+static int report(const char *test, tpool_t *pool, int threads)
+{
+    struct tpool_stats s;
+    if (!tpool_stats_snapshot(pool, &s)) {
+        fprintf(stderr, "the pool was built without TPOOL_STATS.\n");
+        return -1;
+    }
+    printf("%s,%d,%lu,%lu,%lu,%lu,%lu,%lu,%.3f,%lu,%lu,%lu,%lu\n", test,
+           threads, s.jobs, s.steals, s.pop_retries, s.spins, s.yields,
+           s.parks, s.idle_ns / 1e6,
+           (unsigned long)tpool_stats_percentile(s.queue_wait, 50),
+           (unsigned long)tpool_stats_percentile(s.queue_wait, 99),
+           (unsigned long)tpool_stats_percentile(s.run_time, 50),
+           (unsigned long)tpool_stats_percentile(s.run_time, 99));
+    return 0;
+}
+
+/* bursts of empty jobs through the shared queue */
+static int run_burst(const char *test, enum tpool_wait wait, int threads,
+                     int jobs)
+{
+    enum { BURST = 256 };
+    struct tpool_future *futures[BURST];
+    void *args[BURST] = { 0 };
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .wait = wait };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+    int failed = 0;
+    for (int done = 0; done < jobs; done += BURST) {
+        int n = jobs - done < BURST ? jobs - done : BURST;
+        if ((int)add_jobs(&pool, nop, args, n, futures) != n) {
+            failed = 1;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+        }
+    }
+    tpool_wait_idle(&pool);
+    if (!failed)
+        failed = report(test, &pool, threads);
+    tpool_destroy(&pool);
+    return failed ? -1 : 0;
+}
+
+/* recursive spawning on the deques, with stealing */
+static int run_spawn(int threads, int n)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .sched = TPOOL_SCHED_STEAL };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    fib_pool = &pool;
+    tpool_run(&pool);
+    struct tpool_future *future = add_job(&pool, fib_job, (void *)(long)n);
+    long result = -1;
+    if (future) {
+        tpool_future_wait(future);
+        if (future->result)
+            result = *(long *)future->result;
+        tpool_future_destroy(future);
+    }
+    tpool_wait_idle(&pool);
+    int failed = result != fib_serial(n);
+    if (failed)
+        fprintf(stderr, "fib(%d) came out wrong.\n", n);
+    else
+        failed = report("spawn", &pool, threads);
+    tpool_destroy(&pool);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), jobs = 200000, opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            jobs = bench_arg(optarg, "job count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n jobs]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("test,threads,jobs,steals,pop_retries,spins,yields,parks,idle_ms,"
+           "queue_wait_p50_ns,queue_wait_p99_ns,run_time_p50_ns,"
+           "run_time_p99_ns\n");
+    /* about as many spawned jobs as the bursts run */
+    int n = CUTOFF;
+    while (n < 40 && fib_serial(n - CUTOFF + 3) <= jobs)
+        n++;
+    if (run_burst("burst-park", TPOOL_WAIT_PARK, threads, jobs) ||
+        run_burst("burst-spin", TPOOL_WAIT_SPIN, threads, jobs) ||
+        run_spawn(threads, n))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
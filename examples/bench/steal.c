@@ -0,0 +1,114 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* A recursive workload: naive Fibonacci where every call above a cutoff
+ * spawns one half as a job and computes the other half itself. Every job
+ * spawns more jobs, which is the shape the shared queue handles worst.
+ */
+
+#define CUTOFF 12
+
+struct fib {
+    int n;
+    long result;
+};
+
+static tpool_t *fib_pool;
+
+static long fib_serial(int n)
+{
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static void *fib_job(void *arg)
+{
+    struct fib *f = arg;
+    if (f->n < CUTOFF) {
+        f->result = fib_serial(f->n);
+        return NULL;
+    }
+
+    struct fib left = { .n = f->n - 1 }, right = { .n = f->n - 2 };
+    struct tpool_future *future = add_job(fib_pool, fib_job, &left);
+    fib_job(&right);
+    if (future) {
+        tpool_future_wait(future);
+        tpool_future_destroy(future);
+    } else {
+        /* could not spawn: do it ourselves */
+        fib_job(&left);
+    }
+    f->result = left.result + right.result;
+    return NULL;
+}
+
+/* Milliseconds for fib(n) on a fresh pool, or -1 if it went wrong. */
+static double run(enum tpool_sched sched, int threads, int n)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .sched = sched };
+    if (!tpool_init(&pool, threads))
+        return -1;
+    fib_pool = &pool;
+    tpool_run(&pool);
+
+    struct fib root = { .n = n };
+    uint64_t start = bench_now_ns();
+    struct tpool_future *future = add_job(&pool, fib_job, &root);
+    if (future) {
+        tpool_future_wait(future);
+        tpool_future_destroy(future);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+
+    if (!future || root.result != fib_serial(n)) {
+        fprintf(stderr, "fib(%d) came out wrong.\n", n);
+        return -1;
+    }
+    return elapsed / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), n = 32, opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "Fibonacci argument");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n fib]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    static const struct {
+        enum tpool_sched sched;
+        const char *name;
+    } modes[] = {
+        { TPOOL_SCHED_SHARED, "shared" },
+        { TPOOL_SCHED_STEAL, "steal" },
+    };
+
+    printf("sched,threads,n,ms,speedup\n");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        double base = 0;
+        for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+            double ms = run(modes[m].sched, t, n);
+            if (ms < 0)
+                return EXIT_FAILURE;
+            if (t == 1)
+                base = ms;
+            printf("%s,%d,%d,%.2f,%.2f\n", modes[m].name, t, n, ms, base / ms);
+        }
+    }
+    return EXIT_SUCCESS;
+}
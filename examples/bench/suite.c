@@ -0,0 +1,298 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "pools.h"
+#include "tpool.h"
+
+/* Every pool we have under the same jobs: the book's two and the library in
+ * its configurations, each run with the thread count doubling up to -t for a
+ * scaling curve, for every job size and submission pattern asked for. Each
+ * row gives the throughput, the spread of submit-to-complete latencies, and
+ * the CPU time the whole process spent per job, setting up and tearing down
+ * the pool included: a pool that spins while it waits answers quickly and
+ * pays for it there.
+ * "make bench" runs it with the defaults and saves the CSV.
+ *
+ * The submission patterns are
+ *
+ *     burst   add -b jobs at once, wait for all of them, and repeat
+ *     stream  add jobs one at a time as fast as they go in, and only wait
+ *             for them at the end
+ *
+ * The book's pools only take jobs while idle, so they run bursts only, each
+ * on a fresh pool; see pools.h. Another pool joins the comparison with an
+ * entry in "pools" below.
+ */
+
+enum pattern { PATTERN_BURST, PATTERN_STREAM };
+
+static const char *const pattern_names[] = { "burst", "stream" };
+
+struct run {
+    enum pattern pattern;
+    int threads;
+    size_t burst;
+    struct bench_job *jobs;
+    size_t n;
+};
+
+struct pool_kind {
+    const char *name;
+    /* Returns 0 with the time the jobs took in *elapsed, -1 if the pool
+     * failed, and 1 if it cannot run the pattern at all.
+     */
+    int (*run)(const struct pool_kind *kind, const struct run *run,
+               uint64_t *elapsed);
+    /* the library's options, or the book's pool */
+    enum tpool_wait wait;
+    enum tpool_queue queue;
+    int (*burst)(int threads, struct bench_job *jobs, size_t n,
+                 uint64_t *elapsed);
+};
+
+static int run_tpool(const struct pool_kind *kind, const struct run *run,
+                     uint64_t *elapsed)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+                     .wait = kind->wait,
+                     .queue = kind->queue };
+    struct tpool_future **futures = malloc(sizeof(*futures) * run->n);
+    void **args = malloc(sizeof(*args) * run->n);
+    if (!futures || !args || !tpool_init(&pool, run->threads)) {
+        free(futures);
+        free(args);
+        return -1;
+    }
+    for (size_t i = 0; i < run->n; i++)
+        args[i] = &run->jobs[i];
+    tpool_run(&pool);
+
+    uint64_t start = bench_now_ns();
+    size_t added = 0;
+    if (run->pattern == PATTERN_STREAM) {
+        for (; added < run->n; added++) {
+            run->jobs[added].submitted = bench_now_ns();
+            futures[added] = add_job(&pool, bench_job_run, args[added]);
+            if (!futures[added])
+                break;
+        }
+        for (size_t i = 0; i < added; i++) {
+            tpool_future_wait(futures[i]);
+            tpool_future_destroy(futures[i]);
+        }
+    } else {
+        while (added < run->n) {
+            size_t n = run->n - added < run->burst ? run->n - added
+                                                   : run->burst;
+            uint64_t now = bench_now_ns();
+            for (size_t i = 0; i < n; i++)
+                run->jobs[added + i].submitted = now;
+            size_t k = add_jobs(&pool, bench_job_run, args + added, n,
+                                futures + added);
+            for (size_t i = 0; i < k; i++) {
+                tpool_future_wait(futures[added + i]);
+                tpool_future_destroy(futures[added + i]);
+            }
+            added += k;
+            if (k < n)
+                break;
+        }
+    }
+    *elapsed = bench_now_ns() - start;
+
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+    free(futures);
+    free(args);
+    return added == run->n ? 0 : -1;
+}
+
+static int run_book(const struct pool_kind *kind, const struct run *run,
+                    uint64_t *elapsed)
+{
+    if (run->pattern != PATTERN_BURST)
+        return 1;
+    *elapsed = 0;
+    for (size_t done = 0; done < run->n; done += run->burst) {
+        size_t n = run->n - done < run->burst ? run->n - done : run->burst;
+        uint64_t ns;
+        if (kind->burst(run->threads, run->jobs + done, n, &ns))
+            return -1;
+        *elapsed += ns;
+    }
+    return 0;
+}
+
+static const struct pool_kind pools[] = {
+    { .name = "book-rmw", .run = run_book, .burst = book_rmw_burst },
+    { .name = "book-aba", .run = run_book, .burst = book_aba_burst },
+    { .name = "tpool", .run = run_tpool },
+    { .name = "tpool-spin", .run = run_tpool, .wait = TPOOL_WAIT_SPIN },
+    { .name = "tpool-list", .run = run_tpool, .queue = TPOOL_QUEUE_LIST },
+    { .name = "tpool-mutex", .run = run_tpool, .queue = TPOOL_QUEUE_MUTEX },
+    { .name = "tpool-spinlock", .run = run_tpool, .queue = TPOOL_QUEUE_SPIN },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Whether name is one of the comma-separated list; a NULL list has all. */
+static int in_list(const char *list, const char *name)
+{
+    if (!list)
+        return 1;
+    size_t len = strlen(name);
+    for (const char *p = list; p; p = strchr(p, ',')) {
+        if (*p == ',')
+            p++;
+        if (!strncmp(p, name, len) && (p[len] == ',' || p[len] == '\0'))
+            return 1;
+    }
+    return 0;
+}
+
+static int pool_known(const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(pools); i++) {
+        if (!strcmp(pools[i].name, name))
+            return 1;
+    }
+    return 0;
+}
+
+static int pattern_known(const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(pattern_names); i++) {
+        if (!strcmp(pattern_names[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+/* Exit with a usage error if list names anything unknown. */
+static void check_list(const char *list, int (*known)(const char *),
+                       const char *what)
+{
+    if (!list)
+        return;
+    size_t len = strlen(list);
+    char copy[len + 1], *save;
+    memcpy(copy, list, len + 1);
+    for (char *tok = strtok_r(copy, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (!known(tok)) {
+            fprintf(stderr, "unknown %s: '%s'\n", what, tok);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void report(const char *pool, const struct run *run, uint64_t work,
+                  uint64_t elapsed, uint64_t cpu, uint64_t *latency)
+{
+    for (size_t i = 0; i < run->n; i++)
+        latency[i] = run->jobs[i].done - run->jobs[i].submitted;
+    printf("%s,%s,%d,%llu,%zu,%zu,%.0f,%llu,%llu,%llu,%.0f\n", pool,
+           pattern_names[run->pattern], run->threads,
+           (unsigned long long)work, run->burst, run->n,
+           run->n / (elapsed / 1e9),
+           (unsigned long long)bench_percentile(latency, run->n, 50),
+           (unsigned long long)bench_percentile(latency, run->n, 99),
+           (unsigned long long)bench_percentile(latency, run->n, 99.9),
+           (double)cpu / run->n);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), jobs = 100000, burst = 256, opt;
+    const char *pool_list = NULL, *pattern_list = NULL, *work_list = "0,1000";
+    while ((opt = getopt(argc, argv, "t:n:b:w:p:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            jobs = bench_arg(optarg, "job count");
+            break;
+        case 'b':
+            burst = bench_arg(optarg, "burst size");
+            break;
+        case 'w':
+            work_list = optarg;
+            break;
+        case 'p':
+            pool_list = optarg;
+            break;
+        case 's':
+            pattern_list = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-t threads] [-n jobs] [-b burst] "
+                    "[-w ns,...] [-p pool,...] [-s pattern,...]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    check_list(pool_list, pool_known, "pool");
+    check_list(pattern_list, pattern_known, "pattern");
+
+    /* job sizes: nanoseconds each job spins for, 0 for an empty job */
+    uint64_t work[16];
+    size_t nwork = 0;
+    for (const char *p = work_list; *p;) {
+        char *end;
+        long long ns = strtoll(p, &end, 10);
+        if (end == p || ns < 0 || (*end && *end != ',') ||
+            nwork == ARRAY_SIZE(work)) {
+            fprintf(stderr, "invalid job sizes: '%s'\n", work_list);
+            return EXIT_FAILURE;
+        }
+        work[nwork++] = ns;
+        p = *end ? end + 1 : end;
+    }
+
+    struct bench_job *records = malloc(sizeof(*records) * jobs);
+    uint64_t *latency = malloc(sizeof(*latency) * jobs);
+    if (!records || !latency)
+        return EXIT_FAILURE;
+
+    printf("pool,pattern,threads,work_ns,burst,jobs,jobs_per_sec,p50_ns,"
+           "p99_ns,p999_ns,cpu_ns_per_job\n");
+    for (size_t k = 0; k < ARRAY_SIZE(pools); k++) {
+        if (!in_list(pool_list, pools[k].name))
+            continue;
+        for (size_t s = 0; s < ARRAY_SIZE(pattern_names); s++) {
+            if (!in_list(pattern_list, pattern_names[s]))
+                continue;
+            for (size_t w = 0; w < nwork; w++) {
+                for (int t = 1; t <= threads;
+                     t = bench_next_threads(t, threads)) {
+                    struct run run = { .pattern = s,
+                                       .threads = t,
+                                       .burst = burst,
+                                       .jobs = records,
+                                       .n = jobs };
+                    for (int i = 0; i < jobs; i++)
+                        records[i] = (struct bench_job){ .work_ns = work[w] };
+                    uint64_t elapsed, cpu = bench_cpu_ns();
+                    int ret = pools[k].run(&pools[k], &run, &elapsed);
+                    cpu = bench_cpu_ns() - cpu;
+                    if (ret > 0)
+                        break;
+                    if (ret < 0) {
+                        fprintf(stderr, "%s failed.\n", pools[k].name);
+                        return EXIT_FAILURE;
+                    }
+                    report(pools[k].name, &run, work[w], elapsed, cpu,
+                           latency);
+                }
+            }
+        }
+    }
+    free(records);
+    free(latency);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+#include "typed.h"
+
+/* The book's job, one BBP term, -n times on a pool of a thread count
+ * doubling up to -t, three ways:
+ *
+ *     boxed   as rmw_example.c has it: the argument a pointer to a long, the
+ *             result a malloc'ed double
+ *     inline  the same job, returning its double in tpool_result_alloc
+ *     typed   a TPOOL_TYPED pool of long to double: argument and result in
+ *             the future, and the term called directly
+ *
+ * The jobs are added one at a time and then waited for in order, with the
+ * clock running over both, so ns_per_job is what a small job costs all in.
+ * The terms are added up and checked against pi.
+ */
+
+static double term(long k)
+{
+    double sum = (4.0 / (8 * k + 1)) - (2.0 / (8 * k + 4)) -
+                 (1.0 / (8 * k + 5)) - (1.0 / (8 * k + 6));
+    return 1 / pow(16, k) * sum;
+}
+
+static void *boxed_job(void *arg)
+{
+    double *product = malloc(sizeof(double));
+    if (!product)
+        return NULL;
+    *product = term(*(long *)arg);
+    return product;
+}
+
+static void *inline_job(void *arg)
+{
+    double *product = tpool_result_alloc(sizeof(double));
+    if (!product)
+        return NULL;
+    *product = term(*(long *)arg);
+    return product;
+}
+
+TPOOL_TYPED(bbp_term, long, double, term)
+
+enum kind { KIND_BOXED, KIND_INLINE, KIND_TYPED, KINDS };
+
+static const char *const kind_names[] = { "boxed", "inline", "typed" };
+
+/* Milliseconds for n terms summed into *pi, or -1. */
+static double run(enum kind kind, int threads, long n, long *terms,
+                  void **futures, double *pi)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT };
+    *pi = 0;
+    if (!tpool_init(&pool, threads))
+        return -1;
+    tpool_run(&pool);
+
+    bool ok = true;
+    uint64_t start = bench_now_ns();
+    long added = 0;
+    for (; added < n; added++) {
+        if (kind == KIND_TYPED)
+            futures[added] = bbp_term_add(&pool, added);
+        else
+            futures[added] =
+                add_job(&pool, kind == KIND_BOXED ? boxed_job : inline_job,
+                        &terms[added]);
+        if (!futures[added])
+            break;
+    }
+    for (long i = 0; i < added; i++) {
+        if (kind == KIND_TYPED) {
+            *pi += bbp_term_wait(futures[i]);
+            bbp_term_destroy(futures[i]);
+            continue;
+        }
+        struct tpool_future *future = futures[i];
+        tpool_future_wait(future);
+        if (future->result)
+            *pi += *(double *)future->result;
+        else
+            ok = false;
+        tpool_future_destroy(future);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    tpool_destroy(&pool);
+    return ok && added == n ? elapsed / 1e6 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long n = 100000;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            n = bench_arg(optarg, "job count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n jobs]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    long *terms = malloc(sizeof(*terms) * n);
+    void **futures = malloc(sizeof(*futures) * n);
+    if (!terms || !futures)
+        return EXIT_FAILURE;
+    for (long i = 0; i < n; i++)
+        terms[i] = i;
+
+    printf("pool,threads,jobs,ms,jobs_per_sec,ns_per_job\n");
+    for (int kind = 0; kind < KINDS; kind++) {
+        for (int k = 1; k <= threads; k = bench_next_threads(k, threads)) {
+            double pi;
+            double ms = run(kind, k, n, terms, futures, &pi);
+            /* the terms past the first dozen are below double precision */
+            if (ms < 0 || (n >= 12 && fabs(pi - M_PI) > 1e-12)) {
+                fprintf(stderr, "%s: failed, or pi came out %.15f.\n",
+                        kind_names[kind], pi);
+                return EXIT_FAILURE;
+            }
+            printf("%s,%d,%ld,%.3f,%.0f,%.1f\n", kind_names[kind], k, n, ms,
+                   n / ms * 1e3, ms * 1e6 / n);
+        }
+    }
+    free(futures);
+    free(terms);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tpool.h"
+
+/* Compare the two ways a pool can wait for work: what an idle pool costs in
+ * CPU, and how long a job submitted to it then takes to start running.
+ */
+
+static void *stamp(void *arg)
+{
+    *(uint64_t *)arg = bench_now_ns();
+    return NULL;
+}
+
+/* Share of one core the whole process burns while the pool has no work.
+ * Start measuring only after the spin phase is over, since the question is
+ * what the pool costs once it has settled.
+ */
+static double idle_cpu_pct(uint64_t window_ns)
+{
+    bench_sleep_ns(window_ns / 2);
+    uint64_t cpu = bench_cpu_ns(), wall = bench_now_ns();
+    bench_sleep_ns(window_ns);
+    cpu = bench_cpu_ns() - cpu;
+    wall = bench_now_ns() - wall;
+    return 100.0 * cpu / wall;
+}
+
+static int run(enum tpool_wait wait, int threads, int rounds)
+{
+    tpool_t pool = { .initialized = ATOMIC_FLAG_INIT, .wait = wait };
+    uint64_t *lat = malloc(sizeof(*lat) * rounds);
+    if (!lat || !tpool_init(&pool, threads)) {
+        free(lat);
+        return -1;
+    }
+
+    tpool_run(&pool);
+    double cpu = idle_cpu_pct(200000000);
+    for (int r = 0; r < rounds; r++) {
+        /* give the workers time to go back to sleep, if they do */
+        bench_sleep_ns(1000000);
+        uint64_t started = 0, submitted = bench_now_ns();
+        struct tpool_future *future = add_job(&pool, stamp, &started);
+        if (!future) {
+            tpool_destroy(&pool);
+            free(lat);
+            return -1;
+        }
+        tpool_future_wait(future);
+        lat[r] = started - submitted;
+        tpool_future_destroy(future);
+    }
+    tpool_wait_idle(&pool);
+    tpool_destroy(&pool);
+
+    printf("%s,%d,%.1f,%.1f,%.1f,%.1f\n",
+           wait == TPOOL_WAIT_SPIN ? "spin" : "park", threads, cpu,
+           bench_percentile(lat, rounds, 50) / 1e3,
+           bench_percentile(lat, rounds, 99) / 1e3,
+           bench_percentile(lat, rounds, 100) / 1e3);
+    free(lat);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), rounds = 200, opt;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            rounds = bench_arg(optarg, "round count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n rounds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("mode,threads,idle_cpu_pct,start_p50_us,start_p99_us,"
+           "start_max_us\n");
+    if (run(TPOOL_WAIT_SPIN, threads, rounds) ||
+        run(TPOOL_WAIT_PARK, threads, rounds)) {
+        fprintf(stderr, "failed to set up the pool.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
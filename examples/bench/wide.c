@@ -0,0 +1,205 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "wide.h"
+
+/* Records of 32, 64 and 128 bytes, read by -t threads -n times each while a
+ * writer keeps replacing them, two ways:
+ *
+ *     libatomic  _Atomic of the record, which the compiler hands to
+ *                libatomic and libatomic to one of its locks
+ *     seqlock    the same record through WIDE_ATOMIC, see tpool/wide.h
+ *
+ * The writer fills every word of a record with the same number, so a reader
+ * that sees two different ones has caught a torn read, and the run fails.
+ * Reads per second are over all readers together; the writer's stores per
+ * second show how much the readers hold it back.
+ */
+
+#define RECORD(bytes)                                                         \
+    struct rec##bytes {                                                       \
+        wide_word v[(bytes) / sizeof(wide_word)];                             \
+    };                                                                        \
+    WIDE_ATOMIC(wide##bytes, struct rec##bytes)                               \
+                                                                              \
+    static bool check##bytes(const struct rec##bytes *r)                      \
+    {                                                                         \
+        for (size_t i = 1; i < sizeof(r->v) / sizeof(r->v[0]); i++) {        \
+            if (r->v[i] != r->v[0])                                           \
+                return false;                                                 \
+        }                                                                     \
+        return true;                                                          \
+    }                                                                         \
+    static void fill##bytes(struct rec##bytes *r, wide_word k)                \
+    {                                                                         \
+        for (size_t i = 0; i < sizeof(r->v) / sizeof(r->v[0]); i++)          \
+            r->v[i] = k;                                                      \
+    }                                                                         \
+                                                                              \
+    static bool locked_read##bytes(void *obj)                                 \
+    {                                                                         \
+        struct rec##bytes r = atomic_load((_Atomic struct rec##bytes *)obj);  \
+        return check##bytes(&r);                                              \
+    }                                                                         \
+    static void locked_write##bytes(void *obj, wide_word k)                   \
+    {                                                                         \
+        struct rec##bytes r;                                                  \
+        fill##bytes(&r, k);                                                   \
+        atomic_store((_Atomic struct rec##bytes *)obj, r);                    \
+    }                                                                         \
+    static bool locked_lock_free##bytes(void *obj)                            \
+    {                                                                         \
+        return atomic_is_lock_free((_Atomic struct rec##bytes *)obj);        \
+    }                                                                         \
+                                                                              \
+    static bool seq_read##bytes(void *obj)                                    \
+    {                                                                         \
+        struct rec##bytes r;                                                  \
+        wide##bytes##_load(obj, &r);                                          \
+        return check##bytes(&r);                                              \
+    }                                                                         \
+    static void seq_write##bytes(void *obj, wide_word k)                      \
+    {                                                                         \
+        struct rec##bytes r;                                                  \
+        fill##bytes(&r, k);                                                   \
+        wide##bytes##_store(obj, &r);                                         \
+    }                                                                         \
+    static bool seq_lock_free##bytes(void *obj)                               \
+    {                                                                         \
+        (void)obj;                                                            \
+        return WIDE_LOCK_FREE;                                                \
+    }
+
+RECORD(32)
+RECORD(64)
+RECORD(128)
+
+struct method {
+    const char *name;
+    size_t bytes;
+    bool (*read)(void *obj); /* false on a torn read */
+    void (*write)(void *obj, wide_word k);
+    bool (*lock_free)(void *obj);
+};
+
+#define METHODS(bytes)                                                        \
+    { "libatomic", bytes, locked_read##bytes, locked_write##bytes,           \
+      locked_lock_free##bytes },                                              \
+    {                                                                         \
+        "seqlock", bytes, seq_read##bytes, seq_write##bytes,                  \
+            seq_lock_free##bytes                                              \
+    }
+
+static const struct method methods[] = { METHODS(32), METHODS(64),
+                                          METHODS(128) };
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Big enough, and aligned enough, for any of the records either way. */
+struct object {
+    _Alignas(CACHE_LINE_SIZE) unsigned char bytes[2 * CACHE_LINE_SIZE + 128];
+};
+
+struct shared {
+    const struct method *m;
+    struct object obj;
+    long reads; /* per reader */
+    _Alignas(CACHE_LINE_SIZE) atomic_bool stop;
+    atomic_bool torn;
+    long writes;
+};
+
+static int reader(void *arg)
+{
+    struct shared *s = arg;
+    for (long i = 0; i < s->reads; i++) {
+        if (!s->m->read(&s->obj)) {
+            atomic_store(&s->torn, true);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int writer(void *arg)
+{
+    struct shared *s = arg;
+    wide_word k = 0;
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed))
+        s->m->write(&s->obj, ++k);
+    s->writes = k;
+    return 0;
+}
+
+/* Milliseconds until every reader is done, or -1. */
+static double run(struct shared *s, int threads, thrd_t *ids)
+{
+    /* zero is a valid record and an even count, whatever ran before */
+    memset(&s->obj, 0, sizeof(s->obj));
+    atomic_init(&s->stop, false);
+    atomic_init(&s->torn, false);
+    thrd_t w;
+    if (thrd_create(&w, writer, s) != thrd_success)
+        return -1;
+    uint64_t start = bench_now_ns();
+    int started = 0;
+    while (started < threads &&
+           thrd_create(&ids[started], reader, s) == thrd_success)
+        started++;
+    for (int i = 0; i < started; i++)
+        thrd_join(ids[i], NULL);
+    uint64_t elapsed = bench_now_ns() - start;
+    atomic_store(&s->stop, true);
+    thrd_join(w, NULL);
+    if (started < threads || atomic_load(&s->torn))
+        return -1;
+    return elapsed / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_ncpus(), opt;
+    long reads = 1000000;
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = bench_arg(optarg, "thread count");
+            break;
+        case 'n':
+            reads = bench_arg(optarg, "read count");
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n reads]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct shared *s = aligned_alloc(_Alignof(struct shared), sizeof(*s));
+    thrd_t *ids = malloc(sizeof(*ids) * threads);
+    if (!s || !ids)
+        return EXIT_FAILURE;
+    s->reads = reads;
+
+    printf("method,bytes,lock_free,readers,reads,ms,reads_per_sec,"
+           "writes_per_sec\n");
+    for (size_t k = 0; k < ARRAY_SIZE(methods); k++) {
+        s->m = &methods[k];
+        for (int t = 1; t <= threads; t = bench_next_threads(t, threads)) {
+            double ms = run(s, t, ids);
+            if (ms < 0) {
+                fprintf(stderr, "%s, %zu bytes: torn read or no threads.\n",
+                        s->m->name, s->m->bytes);
+                return EXIT_FAILURE;
+            }
+            printf("%s,%zu,%d,%d,%ld,%.3f,%.0f,%.0f\n", s->m->name,
+                   s->m->bytes, s->m->lock_free(&s->obj), t, reads * t, ms,
+                   reads * t / ms * 1e3, s->writes / ms * 1e3);
+        }
+    }
+    free(ids);
+    free(s);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,10 @@
+#ifndef TPOOL_CACHELINE_H
+#define TPOOL_CACHELINE_H
+
+/* Coherence granule on every target the pool is tuned for. Getting it wrong
+ * only costs performance: too small and hot fields share a line again, too
+ * large and the padding wastes memory.
+ */
+#define CACHE_LINE_SIZE 64
+
+#endif
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+
+#include "counter.h"
+
+bool counter_init(struct counter *c, int owners)
+{
+    c->slots = aligned_alloc(_Alignof(struct counter_slot),
+                             sizeof(struct counter_slot) * (owners + 1));
+    if (!c->slots)
+        return false;
+    c->owners = owners;
+    for (int i = 0; i <= owners; i++) {
+        atomic_init(&c->slots[i].up, 0);
+        atomic_init(&c->slots[i].down, 0);
+    }
+    return true;
+}
+
+void counter_destroy(struct counter *c)
+{
+    free(c->slots);
+    c->slots = NULL;
+}
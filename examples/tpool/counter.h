@@ -0,0 +1,95 @@
+#ifndef TPOOL_COUNTER_H
+#define TPOOL_COUNTER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacheline.h"
+#include "order.h"
+
+/* A counter split into slots on cache lines of their own, for counts that
+ * many threads bump. One atomic_long under fetch_add, as in the manuscript's
+ * "Shared resources" section, moves its line from core to core on every
+ * update, so the updates queue up behind each other however little else the
+ * threads share. Here a thread updates its own slot, which stays in its own
+ * cache, and only a reader goes through all of them.
+ *
+ * Slots 0 to owners - 1 belong to one thread each, which updates them with a
+ * load and a store; COUNTER_SHARED is the one more slot that any other thread
+ * updates, with a read-modify-write.
+ *
+ * Each slot counts up and down separately, and only ever forward. That is
+ * what makes counter_read_exact sound while updates go on: it adds up the
+ * decrements first and the increments after, and every decrement it sees had
+ * its increment happen before, so the result is never less than the count at
+ * some moment during the call. Once the updates stop it is exact, and for a
+ * counter that never goes below zero, 0 means it was 0 at that moment.
+ * counter_read makes one pass in any order, and is only good as a hint.
+ */
+
+#define COUNTER_SHARED (-1)
+
+struct counter_slot {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong up;
+    atomic_ulong down;
+};
+
+struct counter {
+    struct counter_slot *slots; /* owners + 1, the shared one last */
+    int owners;
+};
+
+bool counter_init(struct counter *c, int owners);
+void counter_destroy(struct counter *c);
+
+static inline struct counter_slot *counter_slot(struct counter *c, int slot)
+{
+    return &c->slots[slot == COUNTER_SHARED ? c->owners : slot];
+}
+
+static inline void counter_bump(atomic_ulong *x, bool shared, unsigned long n,
+                                memory_order order)
+{
+    if (shared)
+        atomic_fetch_add_explicit(x, n, order);
+    else
+        atomic_store_explicit(x, atomic_load_explicit(x, mo_relaxed) + n,
+                              order);
+}
+
+static inline void counter_add(struct counter *c, int slot, unsigned long n)
+{
+    counter_bump(&counter_slot(c, slot)->up, slot == COUNTER_SHARED, n,
+                 mo_relaxed);
+}
+
+/* Release: whatever the thread did before is seen by a counter_read_exact
+ * that counts this.
+ */
+static inline void counter_sub(struct counter *c, int slot, unsigned long n)
+{
+    counter_bump(&counter_slot(c, slot)->down, slot == COUNTER_SHARED, n,
+                 mo_release);
+}
+
+static inline long counter_read(const struct counter *c)
+{
+    unsigned long sum = 0;
+    for (int i = 0; i <= c->owners; i++)
+        sum += atomic_load_explicit(&c->slots[i].up, mo_relaxed) -
+               atomic_load_explicit(&c->slots[i].down, mo_relaxed);
+    return (long)sum;
+}
+
+static inline long counter_read_exact(const struct counter *c)
+{
+    unsigned long down = 0, up = 0;
+    for (int i = 0; i <= c->owners; i++)
+        down += atomic_load_explicit(&c->slots[i].down, mo_acquire);
+    for (int i = 0; i <= c->owners; i++)
+        up += atomic_load_explicit(&c->slots[i].up, mo_relaxed);
+    return (long)(up - down);
+}
+
+#endif
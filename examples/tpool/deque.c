@@ -0,0 +1,60 @@
+#include <stdlib.h>
+
+#include "deque.h"
+
+static struct deque_array *deque_array_create(long size)
+{
+    struct deque_array *a =
+        malloc(sizeof(struct deque_array) + sizeof(_Atomic(void *)) * size);
+    if (a)
+        a->mask = size - 1;
+    return a;
+}
+
+static void deque_array_reclaim(struct ebr_node *retired)
+{
+    free(retired);
+}
+
+bool deque_init(struct deque *dq, long size, struct ebr *ebr)
+{
+    long n = 2;
+    while (n < size)
+        n <<= 1;
+
+    struct deque_array *a = deque_array_create(n);
+    if (!a)
+        return false;
+    atomic_init(&dq->top, 0);
+    atomic_init(&dq->bottom, 0);
+    atomic_init(&dq->array, a);
+    dq->ebr = ebr;
+    return true;
+}
+
+void deque_destroy(struct deque *dq)
+{
+    /* outgrown arrays go when the domain they were retired to does */
+    free(atomic_load(&dq->array));
+    atomic_store(&dq->array, NULL);
+}
+
+struct deque_array *deque_grow(struct deque *dq, struct deque_array *a,
+                               long top, long bottom)
+{
+    struct deque_array *bigger = deque_array_create((a->mask + 1) * 2);
+    if (!bigger)
+        return NULL;
+    for (long i = top; i < bottom; i++)
+        atomic_init(&bigger->buf[i & bigger->mask],
+                    atomic_load_explicit(&a->buf[i & a->mask], mo_relaxed));
+    /* relaxed: deque_push publishes it along with the item */
+    atomic_store_explicit(&dq->array, bigger, mo_relaxed);
+    /* A thief may have loaded the old array and still be reading from it, so
+     * it cannot be freed here.
+     */
+    struct ebr_record *rec = ebr_enter(dq->ebr);
+    ebr_retire(dq->ebr, rec, &a->retire, deque_array_reclaim);
+    ebr_exit(dq->ebr, rec);
+    return bigger;
+}
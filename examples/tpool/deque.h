@@ -0,0 +1,120 @@
+#ifndef TPOOL_DEQUE_H
+#define TPOOL_DEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "cacheline.h"
+#include "ebr.h"
+#include "order.h"
+#include "stats.h"
+
+/* Work-stealing deque of pointers after Chase and Lev, in the C11 form given
+ * by Lê et al. ("Correct and Efficient Work-Stealing for Weak Memory Models",
+ * PPoPP 2013). One owner pushes and takes at the bottom, as a stack, so what
+ * it spawned last is still hot in its cache when it runs. Any number of
+ * thieves steal from the top, the oldest and typically largest piece of work.
+ * The owner only contends with thieves over the very last item. The memory
+ * orders are the paper's, which it proves correct.
+ */
+struct deque_array {
+    struct ebr_node retire; /* first, so a retired array is its own handle */
+    long mask;
+    _Atomic(void *) buf[];
+};
+
+struct deque {
+    _Alignas(CACHE_LINE_SIZE) atomic_long top; /* thieves */
+    _Alignas(CACHE_LINE_SIZE) atomic_long bottom; /* owner */
+    _Atomic(struct deque_array *) array;
+    struct ebr *ebr; /* outgrown arrays are retired to it */
+};
+
+/* size is rounded up to a power of two; the deque grows past it as needed.
+ * Thieves read the array without taking part in its growth, so an outgrown
+ * array is retired to ebr rather than freed, and deque_steal must be called
+ * inside a critical section of it.
+ */
+bool deque_init(struct deque *dq, long size, struct ebr *ebr);
+void deque_destroy(struct deque *dq);
+
+/* Doubles the array, for deque_push. Returns NULL when out of memory. */
+struct deque_array *deque_grow(struct deque *dq, struct deque_array *a,
+                               long top, long bottom);
+
+/* owner only; returns false if the deque was full and could not grow */
+static inline bool deque_push(struct deque *dq, void *item)
+{
+    long b = atomic_load_explicit(&dq->bottom, mo_relaxed);
+    long t = atomic_load_explicit(&dq->top, mo_acquire);
+    struct deque_array *a = atomic_load_explicit(&dq->array, mo_relaxed);
+    if (b - t > a->mask) {
+        a = deque_grow(dq, a, t, b);
+        if (!a)
+            return false;
+    }
+    atomic_store_explicit(&a->buf[b & a->mask], item, mo_relaxed);
+    /* publishes the item, and a grown array, to thieves that read bottom */
+    atomic_thread_fence(mo_release);
+    atomic_store_explicit(&dq->bottom, b + 1, mo_relaxed);
+    return true;
+}
+
+/* owner only; returns NULL if the deque is empty */
+static inline void *deque_take(struct deque *dq)
+{
+    /* Claim the bottom item before looking at top. A thief does the reverse,
+     * so when only one item is left at least one of the two notices the
+     * other, and the CAS on top below settles who gets it. Store then load
+     * is the one pair only a full fence keeps in order.
+     */
+    long b = atomic_load_explicit(&dq->bottom, mo_relaxed) - 1;
+    struct deque_array *a = atomic_load_explicit(&dq->array, mo_relaxed);
+    atomic_store_explicit(&dq->bottom, b, mo_relaxed);
+    atomic_thread_fence(mo_seq_cst);
+    long t = atomic_load_explicit(&dq->top, mo_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&dq->bottom, b + 1, mo_relaxed);
+        return NULL;
+    }
+    void *item = atomic_load_explicit(&a->buf[b & a->mask], mo_relaxed);
+    if (t == b) {
+        /* last item: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                     mo_seq_cst, mo_relaxed)) {
+            stats_count(pop_retries);
+            item = NULL;
+        }
+        atomic_store_explicit(&dq->bottom, b + 1, mo_relaxed);
+    }
+    return item;
+}
+
+/* any thread, inside a critical section of dq->ebr; returns NULL if the
+ * deque is empty or another thread won
+ */
+static inline void *deque_steal(struct deque *dq)
+{
+    long t = atomic_load_explicit(&dq->top, mo_acquire);
+    atomic_thread_fence(mo_seq_cst);
+    long b = atomic_load_explicit(&dq->bottom, mo_acquire);
+    if (t >= b)
+        return NULL;
+    struct deque_array *a = atomic_load_explicit(&dq->array, mo_acquire);
+    void *item = atomic_load_explicit(&a->buf[t & a->mask], mo_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                 mo_seq_cst, mo_relaxed)) {
+        stats_count(pop_retries);
+        return NULL;
+    }
+    return item;
+}
+
+/* A snapshot, stale as soon as it is taken; only good as a hint. */
+static inline bool deque_empty(struct deque *dq)
+{
+    return atomic_load_explicit(&dq->bottom, mo_relaxed) <=
+           atomic_load_explicit(&dq->top, mo_relaxed);
+}
+
+#endif
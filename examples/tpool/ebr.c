@@ -0,0 +1,158 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ebr.h"
+#include "park.h"
+
+/* A record's state: free, or held, and then possibly active in a critical
+ * section that announced the epoch in the bits above.
+ */
+#define EBR_FREE 0u
+#define EBR_HELD 1u
+#define EBR_ACTIVE 2u
+#define EBR_SHIFT 2
+
+/* Nodes a record collects before ebr_exit says reclaim is due. */
+#define EBR_BATCH 256
+
+/* Where this thread found a free record last time; only ever a hint. */
+static _Thread_local unsigned int ebr_hint;
+
+bool ebr_init(struct ebr *ebr)
+{
+    ebr->records =
+        aligned_alloc(CACHE_LINE_SIZE, sizeof(*ebr->records) * EBR_RECORDS);
+    if (!ebr->records)
+        return false;
+    for (int i = 0; i < EBR_RECORDS; i++) {
+        struct ebr_record *rec = &ebr->records[i];
+        atomic_init(&rec->state, EBR_FREE);
+        for (int b = 0; b < 3; b++) {
+            rec->limbo[b] = NULL;
+            rec->limbo_epoch[b] = 0;
+        }
+        rec->count = 0;
+    }
+    atomic_init(&ebr->epoch, 0);
+    atomic_init(&ebr->due, false);
+    return true;
+}
+
+static void ebr_free_list(struct ebr_node *node)
+{
+    while (node) {
+        struct ebr_node *next = node->next;
+        node->reclaim(node);
+        node = next;
+    }
+}
+
+void ebr_destroy(struct ebr *ebr)
+{
+    for (int i = 0; i < EBR_RECORDS; i++) {
+        for (int b = 0; b < 3; b++)
+            ebr_free_list(ebr->records[i].limbo[b]);
+    }
+    free(ebr->records);
+    ebr->records = NULL;
+}
+
+struct ebr_record *ebr_enter(struct ebr *ebr)
+{
+    unsigned int i = ebr_hint;
+    for (int tries = 1;; tries++, i = (i + 1) % EBR_RECORDS) {
+        struct ebr_record *rec = &ebr->records[i % EBR_RECORDS];
+        unsigned int epoch = atomic_load_explicit(&ebr->epoch, mo_relaxed);
+        unsigned int expected = EBR_FREE;
+        if (atomic_compare_exchange_strong_explicit(
+                &rec->state, &expected,
+                epoch << EBR_SHIFT | EBR_ACTIVE | EBR_HELD, mo_acquire,
+                mo_relaxed)) {
+            ebr_hint = i % EBR_RECORDS;
+            /* The announcement must be visible before we read anything it
+             * protects, and that is a store followed by loads.
+             */
+            atomic_thread_fence(mo_seq_cst);
+            return rec;
+        }
+        if (tries % EBR_RECORDS == 0)
+            spin_pause();
+    }
+}
+
+void ebr_exit(struct ebr *ebr, struct ebr_record *rec)
+{
+    if (rec->count >= EBR_BATCH && !ebr_due(ebr))
+        atomic_store_explicit(&ebr->due, true, mo_relaxed);
+    /* release: whoever holds the record next sees its limbo lists */
+    atomic_store_explicit(&rec->state, EBR_FREE, mo_release);
+}
+
+void ebr_retire(struct ebr *ebr, struct ebr_record *rec,
+                struct ebr_node *node, void (*reclaim)(struct ebr_node *))
+{
+    unsigned int epoch = atomic_load_explicit(&ebr->epoch, mo_seq_cst);
+    int b = epoch % 3;
+    /* A list from three or more epochs ago keeps waiting under the new tag.
+     * That is later than need be, but it keeps free off this path.
+     */
+    rec->limbo_epoch[b] = epoch;
+    node->reclaim = reclaim;
+    node->next = rec->limbo[b];
+    rec->limbo[b] = node;
+    rec->count++;
+}
+
+/* Whether every thread in a critical section has seen epoch already. */
+static bool ebr_quiescent(struct ebr *ebr, unsigned int epoch)
+{
+    for (int i = 0; i < EBR_RECORDS; i++) {
+        unsigned int state =
+            atomic_load_explicit(&ebr->records[i].state, mo_seq_cst);
+        if ((state & EBR_ACTIVE) &&
+            state >> EBR_SHIFT != (epoch & (UINT_MAX >> EBR_SHIFT)))
+            return false;
+    }
+    return true;
+}
+
+void ebr_reclaim(struct ebr *ebr)
+{
+    atomic_store_explicit(&ebr->due, false, mo_relaxed);
+    unsigned int epoch = atomic_load_explicit(&ebr->epoch, mo_seq_cst);
+    atomic_thread_fence(mo_seq_cst);
+    if (ebr_quiescent(ebr, epoch) &&
+        atomic_compare_exchange_strong_explicit(&ebr->epoch, &epoch,
+                                                epoch + 1, mo_seq_cst,
+                                                mo_seq_cst))
+        epoch++;
+
+    /* Free what waits on the records nobody holds; held ones wait for the
+     * next round.
+     */
+    for (int i = 0; i < EBR_RECORDS; i++) {
+        struct ebr_record *rec = &ebr->records[i];
+        unsigned int expected = EBR_FREE;
+        if (!atomic_compare_exchange_strong_explicit(
+                &rec->state, &expected, EBR_HELD, mo_acquire, mo_relaxed))
+            continue;
+        struct ebr_node *expired = NULL;
+        for (int b = 0; b < 3; b++) {
+            /* signed: a list retired after "epoch" was read is newer */
+            if (rec->limbo[b] && (int)(epoch - rec->limbo_epoch[b]) >= 2) {
+                struct ebr_node *node = rec->limbo[b];
+                rec->limbo[b] = NULL;
+                while (node) {
+                    struct ebr_node *next = node->next;
+                    node->next = expired;
+                    expired = node;
+                    rec->count--;
+                    node = next;
+                }
+            }
+        }
+        atomic_store_explicit(&rec->state, EBR_FREE, mo_release);
+        ebr_free_list(expired);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef TPOOL_EBR_H
+#define TPOOL_EBR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacheline.h"
+#include "order.h"
+
+/* Epoch-based reclamation, after Fraser ("Practical lock-freedom", 2004).
+ *
+ * A lock-free structure cannot free a node the moment it unlinks it: another
+ * thread may have read a pointer to it just before and be about to follow it.
+ * So threads touch such structures only inside a critical section, which
+ * announces the global epoch they saw, and an unlinked node is retired rather
+ * than freed, tagged with the epoch at the time. The epoch only advances once
+ * every thread inside a critical section has announced the current one, so
+ * once it has moved on twice since a node was retired, nobody can still hold
+ * a pointer to it.
+ *
+ * Retiring is a push onto a list of the caller's own; the freeing happens
+ * later and in batches in ebr_reclaim, which belongs somewhere off the hot
+ * path, such as between jobs.
+ */
+struct ebr_node {
+    struct ebr_node *next;
+    void (*reclaim)(struct ebr_node *node);
+};
+
+/* A critical section holds one record for its duration, and the objects it
+ * retires wait on that record. A thread picks whichever record is free, so
+ * there is nothing to register and nothing to clean up when it exits; more
+ * than EBR_RECORDS critical sections at once wait for one to free up.
+ */
+#define EBR_RECORDS 128
+
+struct ebr_record {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint state;
+    unsigned int limbo_epoch[3];
+    struct ebr_node *limbo[3]; /* retired in epochs equal mod 3 */
+    size_t count;              /* nodes in limbo */
+};
+
+struct ebr {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint epoch;
+    _Alignas(CACHE_LINE_SIZE) atomic_bool due; /* worth calling reclaim */
+    struct ebr_record *records;
+};
+
+bool ebr_init(struct ebr *ebr);
+/* Reclaims everything still retired. Nobody may be in a critical section. */
+void ebr_destroy(struct ebr *ebr);
+
+struct ebr_record *ebr_enter(struct ebr *ebr);
+void ebr_exit(struct ebr *ebr, struct ebr_record *rec);
+
+/* Inside a critical section: hand node to reclaim once nobody can reach it.
+ * node is usually the first member of the object retired.
+ */
+void ebr_retire(struct ebr *ebr, struct ebr_record *rec,
+                struct ebr_node *node, void (*reclaim)(struct ebr_node *));
+
+/* Enough has been retired that ebr_reclaim would free a batch. */
+static inline bool ebr_due(struct ebr *ebr)
+{
+    return atomic_load_explicit(&ebr->due, mo_relaxed);
+}
+
+/* Outside a critical section: advance the epoch if every thread has caught
+ * up with it, and free what nobody can reach any more.
+ */
+void ebr_reclaim(struct ebr *ebr);
+
+#endif
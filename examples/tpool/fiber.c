@@ -0,0 +1,262 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fiber.h"
+
+#ifdef FIBER_UCONTEXT
+
+/* A context that starts running entry on the stack given. */
+static bool context_make(fiber_context *context, void *stack, size_t size,
+                         void (*entry)(void))
+{
+    if (getcontext(context) != 0)
+        return false;
+    context->uc_stack.ss_sp = stack;
+    context->uc_stack.ss_size = size;
+    context->uc_link = NULL;
+    makecontext(context, entry, 0);
+    return true;
+}
+
+static void context_switch(fiber_context *from, fiber_context *to)
+{
+    swapcontext(from, to);
+}
+
+static _Noreturn void context_set(fiber_context *to)
+{
+    setcontext(to);
+    /* setcontext only returns on a context that was never filled in */
+    abort();
+}
+
+#else
+
+/* fiber_jump(from, to) pushes what the caller expects to find unchanged on
+ * return, stores the stack pointer in *from, switches to the stack to and
+ * pops the same from there. A new fiber's stack is laid out as if it had
+ * called fiber_jump from fiber_start, with entry where the first register
+ * popped goes, and the return lands on fiber_start, which calls it.
+ */
+void fiber_jump(fiber_context *from, fiber_context to);
+void fiber_start(void);
+
+#if defined(__x86_64__)
+/* rbx, rbp and r12 to r15, and the control bits of MXCSR and the x87 FPU */
+__asm__(".text\n"
+        ".globl fiber_jump\n"
+        ".hidden fiber_jump\n"
+        ".type fiber_jump, @function\n"
+        "fiber_jump:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size fiber_jump, .-fiber_jump\n"
+        ".globl fiber_start\n"
+        ".hidden fiber_start\n"
+        ".type fiber_start, @function\n"
+        "fiber_start:\n"
+        "    callq *%r12\n"
+        "    ud2\n"
+        ".size fiber_start, .-fiber_start\n");
+
+enum { FRAME_WORDS = 8, FRAME_ENTRY = 4, FRAME_RETURN = 7 };
+/* MXCSR and the x87 control word as a new thread has them: all masked */
+#define FRAME_CONTROL (0x1f80 | (uintptr_t)0x037f << 32)
+#elif defined(__aarch64__)
+/* x19 to x30 and d8 to d15 */
+__asm__(".text\n"
+        ".globl fiber_jump\n"
+        ".hidden fiber_jump\n"
+        ".type fiber_jump, %function\n"
+        "fiber_jump:\n"
+        "    sub sp, sp, #160\n"
+        "    stp x19, x20, [sp, #0]\n"
+        "    stp x21, x22, [sp, #16]\n"
+        "    stp x23, x24, [sp, #32]\n"
+        "    stp x25, x26, [sp, #48]\n"
+        "    stp x27, x28, [sp, #64]\n"
+        "    stp x29, x30, [sp, #80]\n"
+        "    stp d8, d9, [sp, #96]\n"
+        "    stp d10, d11, [sp, #112]\n"
+        "    stp d12, d13, [sp, #128]\n"
+        "    stp d14, d15, [sp, #144]\n"
+        "    mov x2, sp\n"
+        "    str x2, [x0]\n"
+        "    mov sp, x1\n"
+        "    ldp x19, x20, [sp, #0]\n"
+        "    ldp x21, x22, [sp, #16]\n"
+        "    ldp x23, x24, [sp, #32]\n"
+        "    ldp x25, x26, [sp, #48]\n"
+        "    ldp x27, x28, [sp, #64]\n"
+        "    ldp x29, x30, [sp, #80]\n"
+        "    ldp d8, d9, [sp, #96]\n"
+        "    ldp d10, d11, [sp, #112]\n"
+        "    ldp d12, d13, [sp, #128]\n"
+        "    ldp d14, d15, [sp, #144]\n"
+        "    add sp, sp, #160\n"
+        "    ret\n"
+        ".size fiber_jump, .-fiber_jump\n"
+        ".globl fiber_start\n"
+        ".hidden fiber_start\n"
+        ".type fiber_start, %function\n"
+        "fiber_start:\n"
+        "    blr x19\n"
+        "    brk #0\n"
+        ".size fiber_start, .-fiber_start\n");
+
+enum { FRAME_WORDS = 20, FRAME_ENTRY = 0, FRAME_RETURN = 11 };
+#endif
+
+static bool context_make(fiber_context *context, void *stack, size_t size,
+                         void (*entry)(void))
+{
+    /* the ABIs of both want the stack 16-byte aligned at a call */
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uintptr_t *frame = (uintptr_t *)top - FRAME_WORDS;
+    for (int i = 0; i < FRAME_WORDS; i++)
+        frame[i] = 0;
+#ifdef FRAME_CONTROL
+    frame[0] = FRAME_CONTROL;
+#endif
+    frame[FRAME_ENTRY] = (uintptr_t)entry;
+    frame[FRAME_RETURN] = (uintptr_t)fiber_start;
+    *context = frame;
+    return true;
+}
+
+static void context_switch(fiber_context *from, fiber_context *to)
+{
+    fiber_jump(from, *to);
+}
+
+static _Noreturn void context_set(fiber_context *to)
+{
+    fiber_context gone;
+    fiber_jump(&gone, *to);
+    abort();
+}
+
+#endif
+
+void fiber_set_init(struct fiber_set *set, void (*entry)(void),
+                    size_t stack_size)
+{
+    set->current = NULL;
+    set->free = NULL;
+    set->runnable = NULL;
+    set->all = NULL;
+    atomic_init(&set->ready, NULL);
+    set->entry = entry;
+    set->stack_size = stack_size ? stack_size : FIBER_STACK_SIZE;
+}
+
+void fiber_set_destroy(struct fiber_set *set)
+{
+    struct fiber *f = set->all;
+    while (f) {
+        struct fiber *next = f->all;
+        munmap(f->stack, f->size);
+        free(f);
+        f = next;
+    }
+    set->all = NULL;
+    set->free = NULL;
+    set->runnable = NULL;
+}
+
+static struct fiber *fiber_create(struct fiber_set *set)
+{
+    struct fiber *f = malloc(sizeof(*f));
+    if (!f)
+        return NULL;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    f->size = (set->stack_size + page - 1) / page * page + page;
+    /* NORESERVE: a stack costs what it has touched, not what it may */
+    f->stack = mmap(NULL, f->size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                    -1, 0);
+    if (f->stack == MAP_FAILED) {
+        free(f);
+        return NULL;
+    }
+    /* stacks grow down on every target this builds for */
+    if (mprotect(f->stack, page, PROT_NONE) != 0 ||
+        !context_make(&f->context, (char *)f->stack + page, f->size - page,
+                      set->entry)) {
+        munmap(f->stack, f->size);
+        free(f);
+        return NULL;
+    }
+    f->set = set;
+    f->all = set->all;
+    set->all = f;
+    return f;
+}
+
+struct fiber *fiber_get(struct fiber_set *set)
+{
+    struct fiber *f = set->free;
+    if (!f)
+        return fiber_create(set);
+    set->free = f->next;
+    return f;
+}
+
+void fiber_put(struct fiber_set *set, struct fiber *f)
+{
+    f->next = set->free;
+    set->free = f;
+}
+
+void fiber_switch(struct fiber_set *set, struct fiber *to)
+{
+    struct fiber *from = set->current;
+    set->current = to;
+    context_switch(from ? &from->context : &set->home, &to->context);
+}
+
+void fiber_yield(struct fiber_set *set, struct fiber *to)
+{
+    fiber_put(set, set->current);
+    fiber_switch(set, to);
+}
+
+_Noreturn void fiber_exit(struct fiber_set *set)
+{
+    set->current = NULL;
+    context_set(&set->home);
+}
+
+struct fiber *fiber_take_ready(struct fiber_set *set)
+{
+    if (!set->runnable) {
+        /* acquire: see what the threads handing them back did before */
+        set->runnable =
+            atomic_exchange_explicit(&set->ready, NULL, mo_acquire);
+    }
+    struct fiber *f = set->runnable;
+    if (f)
+        set->runnable = f->next;
+    return f;
+}
@@ -0,0 +1,124 @@
+#ifndef TPOOL_FIBER_H
+#define TPOOL_FIBER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "order.h"
+
+/* Stacks of their own for the code one thread runs, switched between so
+ * that code can stop halfway and let the thread run something else until it
+ * may go on.
+ *
+ * A set belongs to one thread, which alone creates its fibers, switches
+ * between them and frees them, so a fiber never moves to another thread.
+ * That keeps _Thread_local variables meaning what they did before a switch,
+ * which they would not after a move: the compiler is free to keep the
+ * address of one in a register across the call that switches.
+ *
+ * Fibers nobody runs any more go on a free list, stack and all, and come
+ * back off it before a new one is mapped. The stacks are mapped with a guard
+ * page below them, so that running off the end faults rather than writes
+ * over the next one, and they take memory only for the pages touched.
+ *
+ * The one thing other threads do is hand a stopped fiber back through
+ * fiber_ready. That is a push on a stack the owner only ever takes whole,
+ * so it has no ABA problem to solve.
+ *
+ * swapcontext saves and restores the signal mask, which is a system call
+ * each way and most of what a switch costs. On x86-64 and AArch64 a switch
+ * is instead a few instructions in fiber.c that save the registers a call
+ * has to preserve on the stack being left, and load them from the other.
+ * Signal masks then stay as the thread has them, which is all the pool
+ * needs. FIBER_UCONTEXT picks the portable version, by hand or on anything
+ * else, and under AddressSanitizer, which follows swapcontext from stack to
+ * stack but not a switch it does not know of.
+ */
+#if !(defined(__x86_64__) || defined(__aarch64__)) || !defined(__ELF__) || \
+    defined(__SANITIZE_ADDRESS__)
+#define FIBER_UCONTEXT
+#endif
+#ifdef FIBER_UCONTEXT
+#include <ucontext.h>
+#endif
+
+/* Bytes of stack per fiber, by default. */
+#define FIBER_STACK_SIZE (1024 * 1024)
+
+struct fiber_set;
+
+/* where a fiber, or the thread's own stack, goes on from */
+#ifdef FIBER_UCONTEXT
+typedef ucontext_t fiber_context;
+#else
+typedef void *fiber_context; /* the stack pointer, registers pushed below */
+#endif
+
+struct fiber {
+    fiber_context context;
+    struct fiber *next; /* on a free, runnable or ready list */
+    struct fiber *all;  /* every fiber of the set, to unmap them */
+    struct fiber_set *set;
+    void *stack;
+    size_t size; /* of the mapping, guard page included */
+};
+
+struct fiber_set {
+    fiber_context home;     /* the thread's own stack */
+    struct fiber *current;  /* NULL while on the thread's own stack */
+    struct fiber *free;     /* done with, to run entry anew or go on */
+    struct fiber *runnable; /* handed back, and taken off "ready" */
+    struct fiber *all;
+    _Atomic(struct fiber *) ready; /* handed back by any thread */
+    void (*entry)(void);
+    size_t stack_size;
+};
+
+/* New fibers start in entry, which must not return: it ends with fiber_exit.
+ * A stack_size of 0 means FIBER_STACK_SIZE.
+ */
+void fiber_set_init(struct fiber_set *set, void (*entry)(void),
+                    size_t stack_size);
+/* Unmaps every fiber, whatever it was doing, once none of them runs. */
+void fiber_set_destroy(struct fiber_set *set);
+
+/* A fiber off the free list, or a new one at entry; NULL if out of memory. */
+struct fiber *fiber_get(struct fiber_set *set);
+/* Back on the free list, for one fiber_get handed out but nobody ran. */
+void fiber_put(struct fiber_set *set, struct fiber *f);
+
+/* Stop the current fiber, or the thread's own stack, and run to instead.
+ * Whatever stopped picks up where it left off once switched to in turn.
+ */
+void fiber_switch(struct fiber_set *set, struct fiber *to);
+/* fiber_switch, with the current fiber put on the free list first: it goes
+ * on from here when fiber_get next hands it out and it is switched to.
+ */
+void fiber_yield(struct fiber_set *set, struct fiber *to);
+/* Leave the current fiber for good and go back to the thread's own stack. */
+_Noreturn void fiber_exit(struct fiber_set *set);
+
+/* From any thread: a fiber that stopped can go on. Release, so that what the
+ * thread did before is seen by the fiber once the owner takes it.
+ */
+static inline void fiber_ready(struct fiber *f)
+{
+    struct fiber_set *set = f->set;
+    struct fiber *head = atomic_load_explicit(&set->ready, mo_relaxed);
+    do {
+        f->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&set->ready, &head, f,
+                                                    mo_release, mo_relaxed));
+}
+
+/* The owner: the next fiber handed back, or NULL. */
+struct fiber *fiber_take_ready(struct fiber_set *set);
+
+/* The owner: whether one has been handed back. */
+static inline bool fiber_any_ready(struct fiber_set *set)
+{
+    return set->runnable || atomic_load_explicit(&set->ready, mo_relaxed);
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include "lfqueue.h"
+
+static struct lfq_node *node_create(struct lfqueue *q, void *item)
+{
+    struct lfq_node *node = slab_alloc(q->nodes);
+    if (node) {
+        atomic_init(&node->next, NULL);
+        node->item = item;
+        node->slab = q->nodes;
+    }
+    return node;
+}
+
+static void node_reclaim(struct ebr_node *retired)
+{
+    struct lfq_node *node = (struct lfq_node *)retired;
+    slab_free(node->slab, node);
+}
+
+bool lfqueue_init(struct lfqueue *q, struct slab *nodes)
+{
+    q->nodes = nodes;
+    if (!ebr_init(&q->ebr))
+        return false;
+    /* the queue always holds a dummy node at its head */
+    struct lfq_node *dummy = node_create(q, NULL);
+    if (!dummy) {
+        ebr_destroy(&q->ebr);
+        return false;
+    }
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    return true;
+}
+
+void lfqueue_destroy(struct lfqueue *q)
+{
+    /* the nodes still queued, and the dummy, go with the slab */
+    ebr_destroy(&q->ebr);
+}
+
+/* Link the chain first..last after the last node and swing the tail. */
+static void lfqueue_append(struct lfqueue *q, struct lfq_node *first,
+                           struct lfq_node *last)
+{
+    struct ebr_record *rec = ebr_enter(&q->ebr);
+    while (1) {
+        struct lfq_node *tail = atomic_load_explicit(&q->tail, mo_acquire);
+        struct lfq_node *next =
+            atomic_load_explicit(&tail->next, mo_acquire);
+        if (tail != atomic_load_explicit(&q->tail, mo_acquire))
+            continue;
+        if (next) {
+            /* the tail lags behind an enqueue in progress: help it along */
+            atomic_compare_exchange_strong_explicit(
+                &q->tail, &tail, next, mo_release, mo_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+                &tail->next, &next, first, mo_release, mo_relaxed)) {
+            atomic_compare_exchange_strong_explicit(
+                &q->tail, &tail, last, mo_release, mo_relaxed);
+            break;
+        }
+    }
+    ebr_exit(&q->ebr, rec);
+}
+
+bool lfqueue_push(struct lfqueue *q, void *item)
+{
+    struct lfq_node *node = node_create(q, item);
+    if (!node)
+        return false;
+    lfqueue_append(q, node, node);
+    return true;
+}
+
+size_t lfqueue_push_n(struct lfqueue *q, void *(*item)(void *, size_t),
+                      void *ctx, size_t n)
+{
+    if (n == 0)
+        return 0;
+    struct lfq_node *first = NULL, *last = NULL;
+    for (size_t k = 0; k < n; k++) {
+        struct lfq_node *node = node_create(q, item(ctx, k));
+        if (!node) {
+            while (first) {
+                struct lfq_node *next = atomic_load_explicit(
+                    &first->next, mo_relaxed);
+                slab_free(q->nodes, first);
+                first = next;
+            }
+            return 0;
+        }
+        if (last)
+            atomic_store_explicit(&last->next, node, mo_relaxed);
+        else
+            first = node;
+        last = node;
+    }
+    lfqueue_append(q, first, last);
+    return n;
+}
+
+void *lfqueue_pop(struct lfqueue *q)
+{
+    struct ebr_record *rec = ebr_enter(&q->ebr);
+    void *item = NULL;
+    while (1) {
+        struct lfq_node *head = atomic_load_explicit(&q->head, mo_acquire);
+        struct lfq_node *tail = atomic_load_explicit(&q->tail, mo_acquire);
+        struct lfq_node *next =
+            atomic_load_explicit(&head->next, mo_acquire);
+        if (head != atomic_load_explicit(&q->head, mo_acquire))
+            continue;
+        if (!next)
+            break;
+        if (head == tail) {
+            atomic_compare_exchange_strong_explicit(
+                &q->tail, &tail, next, mo_release, mo_relaxed);
+            continue;
+        }
+        /* Read before the CAS: after it, the node is someone else's dummy.
+         * The CAS releases as well as acquires, so that whoever next reads
+         * "head" also sees the links and items of a chain pushed at once.
+         */
+        void *candidate = next->item;
+        if (atomic_compare_exchange_weak_explicit(
+                &q->head, &head, next, mo_acq_rel, mo_relaxed)) {
+            /* the old dummy is unlinked, but others may still be reading
+             * it: retire it, which costs no more than a push
+             */
+            ebr_retire(&q->ebr, rec, &head->retire, node_reclaim);
+            item = candidate;
+            break;
+        }
+        stats_count(pop_retries);
+    }
+    ebr_exit(&q->ebr, rec);
+    return item;
+}
@@ -0,0 +1,79 @@
+#ifndef TPOOL_LFQUEUE_H
+#define TPOOL_LFQUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacheline.h"
+#include "ebr.h"
+#include "slab.h"
+#include "stats.h"
+
+/* Unbounded multi-producer, multi-consumer queue of pointers after Michael
+ * and Scott ("Simple, Fast, and Practical Non-Blocking and Blocking
+ * Concurrent Queue Algorithms", PODC 1996).
+ *
+ * This is the job queue of rmw_example_aba.c done without its 16-byte CAS.
+ * The listing pairs each pointer with a version so that a CAS notices the
+ * node was freed and reused in between, and still reads through a pointer
+ * that may be dangling. Here every access happens inside an epoch-based
+ * critical section, and a dequeued node is retired rather than freed, so
+ * no node is reused while anybody can still reach it. There is no ABA left
+ * for a version to catch, and every CAS is on a plain pointer.
+ *
+ * Nodes come from a slab and go back to it in batches, from lfqueue_reclaim.
+ * The slab is the caller's, so that queues used side by side can share one
+ * and a thread working on all of them keeps a single cache of nodes.
+ */
+struct lfq_node {
+    struct ebr_node retire; /* first, so a retired node is its own handle */
+    _Atomic(struct lfq_node *) next;
+    void *item;
+    struct slab *slab; /* where it goes back to */
+};
+
+struct lfqueue {
+    _Alignas(CACHE_LINE_SIZE) _Atomic(struct lfq_node *) head;
+    _Alignas(CACHE_LINE_SIZE) _Atomic(struct lfq_node *) tail;
+    struct ebr ebr;
+    struct slab *nodes;
+};
+
+/* nodes must be a slab of struct lfq_node, and outlive the queue. */
+bool lfqueue_init(struct lfqueue *q, struct slab *nodes);
+/* Nobody may be using the queue any more. Nodes still queued stay in the
+ * slab until it is destroyed.
+ */
+void lfqueue_destroy(struct lfqueue *q);
+
+/* Returns false only when out of memory. */
+bool lfqueue_push(struct lfqueue *q, void *item);
+/* Push n items, item(ctx, i) being the i-th, linked into the queue with one
+ * CAS. Returns the number pushed, all or nothing.
+ */
+size_t lfqueue_push_n(struct lfqueue *q, void *(*item)(void *, size_t),
+                      void *ctx, size_t n);
+/* Returns NULL if the queue is empty. */
+void *lfqueue_pop(struct lfqueue *q);
+
+/* A snapshot, stale as soon as it is taken; only good as a hint. It may
+ * miss an item whose push has not swung the tail yet, but never one whose
+ * push has returned.
+ */
+static inline bool lfqueue_empty(struct lfqueue *q)
+{
+    return atomic_load_explicit(&q->head, mo_relaxed) ==
+           atomic_load_explicit(&q->tail, mo_relaxed);
+}
+
+/* Give the nodes popped a while ago back to the slab, if enough have piled
+ * up. Cheap when there is nothing to do; call it between jobs.
+ */
+static inline void lfqueue_reclaim(struct lfqueue *q)
+{
+    if (ebr_due(&q->ebr))
+        ebr_reclaim(&q->ebr);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#include <stdlib.h>
+
+#include "lockqueue.h"
+
+bool lockqueue_init(struct lockqueue *q, size_t capacity,
+                    enum lockqueue_lock kind)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    q->items = malloc(sizeof(void *) * size);
+    if (!q->items)
+        return false;
+    q->kind = kind;
+    if (kind == LOCKQUEUE_MUTEX &&
+        mtx_init(&q->mtx, mtx_plain) != thrd_success) {
+        free(q->items);
+        return false;
+    }
+    ttas_init(&q->spin);
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return true;
+}
+
+void lockqueue_destroy(struct lockqueue *q)
+{
+    if (q->kind == LOCKQUEUE_MUTEX)
+        mtx_destroy(&q->mtx);
+    free(q->items);
+    q->items = NULL;
+}
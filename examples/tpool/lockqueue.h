@@ -0,0 +1,117 @@
+#ifndef TPOOL_LOCKQUEUE_H
+#define TPOOL_LOCKQUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+#include "cacheline.h"
+#include "order.h"
+#include "spinlock.h"
+
+/* Bounded queue of pointers behind a lock, for the manuscript's lock-based
+ * SPMC solutions, next to the lock-free ring and list:
+ *
+ *     LOCKQUEUE_MUTEX  "lock-based": a mutex around the array, so a thread
+ *                      preempted while holding it stalls every other one
+ *     LOCKQUEUE_SPIN   "lock-based and lock-free": the same under a
+ *                      test-and-test-and-set lock, and a consumer looks
+ *                      before it locks, so nobody ever takes the lock to
+ *                      find the queue empty
+ *
+ * An idle worker sleeps in the pool rather than in the queue, on the futex
+ * that a condition variable would be built on; see park.h.
+ */
+enum lockqueue_lock { LOCKQUEUE_MUTEX, LOCKQUEUE_SPIN };
+
+struct lockqueue {
+    _Alignas(CACHE_LINE_SIZE) enum lockqueue_lock kind;
+    mtx_t mtx;
+    struct ttas_lock spin;
+    /* Written under the lock only, but read without it by lockqueue_empty,
+     * hence atomic.
+     */
+    atomic_size_t head;
+    atomic_size_t tail;
+    size_t mask;
+    void **items;
+};
+
+/* capacity is rounded up to a power of two */
+bool lockqueue_init(struct lockqueue *q, size_t capacity,
+                    enum lockqueue_lock kind);
+void lockqueue_destroy(struct lockqueue *q);
+
+static inline void lockqueue_lock(struct lockqueue *q)
+{
+    if (q->kind == LOCKQUEUE_MUTEX)
+        mtx_lock(&q->mtx);
+    else
+        ttas_acquire(&q->spin);
+}
+
+static inline void lockqueue_unlock(struct lockqueue *q)
+{
+    if (q->kind == LOCKQUEUE_MUTEX)
+        mtx_unlock(&q->mtx);
+    else
+        ttas_release(&q->spin);
+}
+
+/* A snapshot, stale as soon as it is taken; only good as a hint. */
+static inline bool lockqueue_empty(struct lockqueue *q)
+{
+    return atomic_load_explicit(&q->head, mo_relaxed) ==
+           atomic_load_explicit(&q->tail, mo_relaxed);
+}
+
+/* Push up to n items, item(ctx, i) being the i-th, under one lock. Returns
+ * the number pushed, 0 if the queue is full.
+ */
+static inline size_t lockqueue_push_n(struct lockqueue *q,
+                                      void *(*item)(void *, size_t),
+                                      void *ctx, size_t n)
+{
+    lockqueue_lock(q);
+    size_t head = atomic_load_explicit(&q->head, mo_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, mo_relaxed);
+    size_t k = q->mask + 1 - (tail - head);
+    if (k > n)
+        k = n;
+    for (size_t i = 0; i < k; i++)
+        q->items[(tail + i) & q->mask] = item(ctx, i);
+    atomic_store_explicit(&q->tail, tail + k, mo_relaxed);
+    lockqueue_unlock(q);
+    return k;
+}
+
+static inline void *lockqueue_item(void *item, size_t i)
+{
+    (void)i;
+    return item;
+}
+
+/* Returns false if the queue is full. */
+static inline bool lockqueue_push(struct lockqueue *q, void *item)
+{
+    return lockqueue_push_n(q, lockqueue_item, item, 1);
+}
+
+/* Returns NULL if the queue is empty. */
+static inline void *lockqueue_pop(struct lockqueue *q)
+{
+    if (q->kind == LOCKQUEUE_SPIN && lockqueue_empty(q))
+        return NULL;
+    void *item = NULL;
+    lockqueue_lock(q);
+    size_t head = atomic_load_explicit(&q->head, mo_relaxed);
+    if (head != atomic_load_explicit(&q->tail, mo_relaxed)) {
+        item = q->items[head & q->mask];
+        atomic_store_explicit(&q->head, head + 1, mo_relaxed);
+    }
+    lockqueue_unlock(q);
+    return item;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef TPOOL_ORDER_H
+#define TPOOL_ORDER_H
+
+#include <stdatomic.h>
+
+/* Memory orders for the pool's atomics. Every operation on the hot path names
+ * the weakest order it is correct with, which on a weakly ordered machine
+ * saves a barrier per poll. Building with -DTPOOL_SEQ_CST turns them all back
+ * into sequential consistency, as plain atomic_load and friends would be: to
+ * measure what the orders buy, and to rule them out when chasing a bug.
+ *
+ * Fences that are seq_cst on purpose say mo_seq_cst, which both builds keep.
+ */
+#ifdef TPOOL_SEQ_CST
+#define mo_relaxed memory_order_seq_cst
+#define mo_acquire memory_order_seq_cst
+#define mo_release memory_order_seq_cst
+#define mo_acq_rel memory_order_seq_cst
+#define TPOOL_ORDER "seq_cst"
+#else
+#define mo_relaxed memory_order_relaxed
+#define mo_acquire memory_order_acquire
+#define mo_release memory_order_release
+#define mo_acq_rel memory_order_acq_rel
+#define TPOOL_ORDER "acq_rel"
+#endif
+#define mo_seq_cst memory_order_seq_cst
+
+#endif
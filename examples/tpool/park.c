@@ -0,0 +1,104 @@
+#include <stdint.h>
+
+#include "park.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The kernel compares the word against "expected" under its own hash bucket
+ * lock and only then queues the caller, so a wake that changes the word first
+ * can never slip in between the check and the sleep.
+ */
+void park_wait(atomic_int *word, int expected)
+{
+    syscall(SYS_futex, (int *)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL,
+            0);
+}
+
+/* FUTEX_WAIT takes its timeout relative to now, unlike most of the API. */
+void park_wait_for(atomic_int *word, int expected, uint64_t ns)
+{
+    struct timespec ts = { .tv_sec = ns / 1000000000,
+                           .tv_nsec = ns % 1000000000 };
+    syscall(SYS_futex, (int *)word, FUTEX_WAIT_PRIVATE, expected, &ts, NULL,
+            0);
+}
+
+void park_wake(atomic_int *word, int n)
+{
+    syscall(SYS_futex, (int *)word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#else
+#include <threads.h>
+#include <time.h>
+
+/* Without a futex, fall back on a condition variable per bucket of addresses,
+ * in the style of a parking lot. Unrelated words that hash to the same bucket
+ * only cost each other a spurious wake-up, which park_wait allows anyway.
+ */
+#define PARK_BUCKETS 64
+
+static struct {
+    mtx_t lock;
+    cnd_t cond;
+} buckets[PARK_BUCKETS];
+static once_flag buckets_once = ONCE_FLAG_INIT;
+
+static void buckets_init(void)
+{
+    for (int i = 0; i < PARK_BUCKETS; i++) {
+        mtx_init(&buckets[i].lock, mtx_plain);
+        cnd_init(&buckets[i].cond);
+    }
+}
+
+static int bucket_of(atomic_int *word)
+{
+    return ((uintptr_t)word / sizeof(*word)) % PARK_BUCKETS;
+}
+
+/* The waker changes the word before it takes the bucket lock, and the waiter
+ * checks the word while holding it, so whichever comes second sees the other.
+ */
+void park_wait(atomic_int *word, int expected)
+{
+    call_once(&buckets_once, buckets_init);
+    int b = bucket_of(word);
+    mtx_lock(&buckets[b].lock);
+    if (atomic_load(word) == expected)
+        cnd_wait(&buckets[b].cond, &buckets[b].lock);
+    mtx_unlock(&buckets[b].lock);
+}
+
+void park_wait_for(atomic_int *word, int expected, uint64_t ns)
+{
+    call_once(&buckets_once, buckets_init);
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    ns += ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    int b = bucket_of(word);
+    mtx_lock(&buckets[b].lock);
+    if (atomic_load(word) == expected)
+        cnd_timedwait(&buckets[b].cond, &buckets[b].lock, &ts);
+    mtx_unlock(&buckets[b].lock);
+}
+
+/* Always everyone: the bucket is shared, so waking just one thread could pick
+ * a sleeper on some other word and leave the one meant here asleep.
+ */
+void park_wake(atomic_int *word, int n)
+{
+    (void)n;
+    call_once(&buckets_once, buckets_init);
+    int b = bucket_of(word);
+    mtx_lock(&buckets[b].lock);
+    cnd_broadcast(&buckets[b].cond);
+    mtx_unlock(&buckets[b].lock);
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef TPOOL_PARK_H
+#define TPOOL_PARK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Sleep until *word no longer holds "expected", or until someone calls
+ * park_wake on it. Like the futex it is built on, it may also return for no
+ * reason at all, so callers re-check their condition in a loop.
+ */
+void park_wait(atomic_int *word, int expected);
+
+/* park_wait, giving up after about "ns" nanoseconds. */
+void park_wait_for(atomic_int *word, int expected, uint64_t ns);
+
+/* Wake up to n of the threads sleeping in park_wait on "word", INT_MAX for
+ * all of them. Change the word before calling this: a thread that has yet to
+ * go to sleep compares against it, and that comparison is what keeps the
+ * wake-up from being lost.
+ */
+void park_wake(atomic_int *word, int n);
+
+/* Tell the core that we are spinning. On x86 "pause" stops the spin loop from
+ * flooding the memory pipeline with speculative loads of a line that another
+ * core is about to write, and on a hyper-threaded core it hands the execution
+ * units to the sibling thread.
+ */
+static inline void spin_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+    __asm__ __volatile__("yield");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+#endif
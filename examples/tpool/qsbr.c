@@ -0,0 +1,105 @@
+#include <stdlib.h>
+
+#include "qsbr.h"
+
+bool qsbr_init(struct qsbr *q, int readers)
+{
+    q->readers =
+        aligned_alloc(CACHE_LINE_SIZE, sizeof(*q->readers) * readers);
+    if (!q->readers)
+        return false;
+    if (mtx_init(&q->lock, mtx_plain) != thrd_success) {
+        free(q->readers);
+        return false;
+    }
+    for (int i = 0; i < readers; i++)
+        atomic_init(&q->readers[i].seen, 0);
+    q->nreaders = readers;
+    atomic_init(&q->period, 1);
+    q->retired = NULL;
+    return true;
+}
+
+static void qsbr_free_list(struct qsbr_node *node)
+{
+    while (node) {
+        struct qsbr_node *next = node->next;
+        node->reclaim(node);
+        node = next;
+    }
+}
+
+void qsbr_destroy(struct qsbr *q)
+{
+    qsbr_free_list(q->retired);
+    q->retired = NULL;
+    mtx_destroy(&q->lock);
+    free(q->readers);
+    q->readers = NULL;
+}
+
+/* Start a grace period after a swap, and return it. The fence orders the
+ * swap before the loads of the readers' slots that follow, against the
+ * fence in qsbr_online.
+ */
+static unsigned long qsbr_advance(struct qsbr *q)
+{
+    unsigned long period =
+        atomic_fetch_add_explicit(&q->period, 1, mo_seq_cst) + 1;
+    atomic_thread_fence(mo_seq_cst);
+    return period;
+}
+
+void qsbr_retire(struct qsbr *q, struct qsbr_node *node,
+                 void (*reclaim)(struct qsbr_node *))
+{
+    node->reclaim = reclaim;
+    mtx_lock(&q->lock);
+    node->period = qsbr_advance(q);
+    node->next = q->retired;
+    q->retired = node;
+    mtx_unlock(&q->lock);
+}
+
+bool qsbr_reclaim(struct qsbr *q)
+{
+    if (mtx_trylock(&q->lock) != thrd_success)
+        return false;
+    /* the oldest period an online reader may still be in */
+    atomic_thread_fence(mo_seq_cst);
+    unsigned long oldest = atomic_load_explicit(&q->period, mo_relaxed);
+    for (int i = 0; i < q->nreaders; i++) {
+        unsigned long seen =
+            atomic_load_explicit(&q->readers[i].seen, mo_acquire);
+        if (seen && seen < oldest)
+            oldest = seen;
+    }
+    struct qsbr_node *expired = NULL, **link = &q->retired;
+    while (*link) {
+        struct qsbr_node *node = *link;
+        if (node->period <= oldest) {
+            *link = node->next;
+            node->next = expired;
+            expired = node;
+        } else {
+            link = &node->next;
+        }
+    }
+    mtx_unlock(&q->lock);
+    qsbr_free_list(expired);
+    return true;
+}
+
+void qsbr_synchronize(struct qsbr *q)
+{
+    unsigned long period = qsbr_advance(q);
+    for (int i = 0; i < q->nreaders; i++) {
+        while (1) {
+            unsigned long seen =
+                atomic_load_explicit(&q->readers[i].seen, mo_acquire);
+            if (!seen || seen >= period)
+                break;
+            thrd_yield();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef TPOOL_QSBR_H
+#define TPOOL_QSBR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+#include "cacheline.h"
+#include "order.h"
+
+/* Read-copy-update with quiescent-state-based reclamation, after McKenney
+ * and Slingwine ("Read-copy update", 1998) and the QSBR flavour of liburcu.
+ *
+ * Data that is read all the time and changed rarely sits behind one atomic
+ * pointer. A reader loads the pointer and reads what it points to, with no
+ * lock, no retry loop and nothing written; a writer builds a new copy,
+ * swaps the pointer, and retires the old copy. What makes freeing it safe is
+ * that readers hold such pointers only between quiescent states, points in
+ * their own code where they hold none, such as a worker between two jobs.
+ * Each reader announces those by copying the global grace period into a slot
+ * of its own; once every reader has announced a period later than the swap,
+ * none of them can still see the old copy.
+ *
+ * Compared with the epochs of ebr.h, a read costs the one acquire load, a
+ * plain load on x86, and no fence, but there is a fixed set of readers, each
+ * identified by an index, and one that stops reporting holds up reclamation
+ * until it does. A reader about to block therefore goes offline, and comes
+ * back online after. Only registered readers may read, and only online.
+ */
+struct qsbr_node {
+    struct qsbr_node *next;
+    void (*reclaim)(struct qsbr_node *node);
+    unsigned long period; /* safe once every reader has seen it */
+};
+
+struct qsbr_reader {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong seen; /* 0 while offline */
+};
+
+struct qsbr {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong period; /* starts at 1 */
+    struct qsbr_reader *readers;
+    int nreaders;
+    mtx_t lock; /* writers, over "retired" */
+    struct qsbr_node *retired;
+};
+
+/* The readers start out offline. */
+bool qsbr_init(struct qsbr *q, int readers);
+/* Reclaims everything still retired. No reader may be online. */
+void qsbr_destroy(struct qsbr *q);
+
+/* Reader i holds no pointer it read under q. Acquire on the period, so that
+ * after announcing a swap's period the reader loads the new pointer; release
+ * on the slot, so that its reads of the old copy are done before a writer
+ * that sees the announcement frees it.
+ */
+static inline void qsbr_quiescent(struct qsbr *q, int i)
+{
+    unsigned long period = atomic_load_explicit(&q->period, mo_acquire);
+    atomic_ulong *seen = &q->readers[i].seen;
+    /* the writer polls this line: leave it alone unless there is news */
+    if (atomic_load_explicit(seen, mo_relaxed) != period)
+        atomic_store_explicit(seen, period, mo_release);
+}
+
+/* Reader i is about to block, and holds no pointer until qsbr_online. */
+static inline void qsbr_offline(struct qsbr *q, int i)
+{
+    atomic_store_explicit(&q->readers[i].seen, 0, mo_release);
+}
+
+static inline void qsbr_online(struct qsbr *q, int i)
+{
+    atomic_store_explicit(&q->readers[i].seen,
+                          atomic_load_explicit(&q->period, mo_acquire),
+                          mo_relaxed);
+    /* Store, then load the pointers it guards: a writer that missed the
+     * store is one whose swap the loads are sure to see.
+     */
+    atomic_thread_fence(mo_seq_cst);
+}
+
+/* Readers load the pointer with qsbr_read; writers publish with
+ * qsbr_publish, after filling in what it points to.
+ */
+#define qsbr_read(p) atomic_load_explicit((p), mo_acquire)
+#define qsbr_publish(p, v) atomic_store_explicit((p), (v), mo_release)
+
+/* After a writer swapped node out of reach: hand it to reclaim once no
+ * reader can hold it. Never blocks on the readers; qsbr_reclaim frees it
+ * later, and in batches.
+ */
+void qsbr_retire(struct qsbr *q, struct qsbr_node *node,
+                 void (*reclaim)(struct qsbr_node *));
+
+/* Free what no reader can reach any more. Returns false if another thread
+ * was at it already, and leaves it to that one.
+ */
+bool qsbr_reclaim(struct qsbr *q);
+
+/* Wait until every reader has passed a quiescent state or been offline since
+ * the call began. Not from an online reader, which would wait for itself.
+ */
+void qsbr_synchronize(struct qsbr *q);
+
+#endif
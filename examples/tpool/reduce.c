@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "order.h"
+#include "tpool.h"
+
+/* The jobs are the leaves of a binary tree. Leaf i's result goes in slot i,
+ * and a node over leaves [i, i + span) keeps its result in slot i as well:
+ * combining two siblings folds the right one's slot into the left one's. The
+ * tree is the one that halves the leaves at the largest power of two below
+ * their count, so its shape only depends on how many leaves there are.
+ *
+ * Of two siblings, the one finishing last does the combining, which takes no
+ * lock: each node has a counter both bump, and whoever finds it already
+ * bumped knows the other result is in. The counter of a node is named by the
+ * first leaf of its right child, which no other node shares.
+ */
+struct reduce {
+    const struct tpool_reduce *reduce;
+    size_t begin, end, grain;
+    size_t leaves;
+    size_t stride; /* between slots, which get a cache line or more each */
+    unsigned char *slots;
+    atomic_int *arrived;
+};
+
+struct reduce_leaf {
+    struct reduce *tree;
+    size_t i;
+};
+
+static void *slot(struct reduce *tree, size_t i)
+{
+    return tree->slots + i * tree->stride;
+}
+
+static void *reduce_leaf(void *arg)
+{
+    struct reduce_leaf *leaf = arg;
+    struct reduce *tree = leaf->tree;
+    const struct tpool_reduce *reduce = tree->reduce;
+    size_t i = leaf->i, begin = tree->begin + i * tree->grain;
+    size_t end = tree->end - begin > tree->grain ? begin + tree->grain
+                                                 : tree->end;
+    memcpy(slot(tree, i), reduce->identity, reduce->size);
+    reduce->map(slot(tree, i), begin, end, reduce->ctx);
+
+    /* up the tree from the node [i, i + span) this leaf just completed */
+    for (size_t span = 1; span < tree->leaves; span *= 2) {
+        size_t right = i;
+        if (i % (2 * span) == 0) {
+            right = i + span;
+            /* no sibling: the node is its own parent */
+            if (right >= tree->leaves)
+                continue;
+        }
+        /* acq_rel: publish our result, and see the sibling's if it is last */
+        if (!atomic_fetch_add_explicit(&tree->arrived[right], 1, mo_acq_rel))
+            return NULL;
+        i = right - span;
+        reduce->combine(slot(tree, i), slot(tree, right), reduce->ctx);
+    }
+    return NULL;
+}
+
+bool tpool_parallel_reduce(tpool_t *thrd_pool, struct tpool_range range,
+                           const struct tpool_reduce *reduce, void *result)
+{
+    if (range.end <= range.begin) {
+        memcpy(result, reduce->identity, reduce->size);
+        return true;
+    }
+    size_t n = range.end - range.begin;
+    struct reduce tree = {
+        .reduce = reduce,
+        .begin = range.begin,
+        .end = range.end,
+        .grain = range.grain ? range.grain
+                             : (n - 1) / TPOOL_REDUCE_JOBS + 1,
+        .stride = (reduce->size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE *
+                  CACHE_LINE_SIZE,
+    };
+    tree.leaves = (n - 1) / tree.grain + 1;
+
+    bool ok = false;
+    struct reduce_leaf *leaves = malloc(sizeof(*leaves) * tree.leaves);
+    void **args = malloc(sizeof(*args) * tree.leaves);
+    struct tpool_future **futures = malloc(sizeof(*futures) * tree.leaves);
+    struct tpool_batch *batch = tpool_batch_create(tree.leaves);
+    tree.arrived = malloc(sizeof(*tree.arrived) * tree.leaves);
+    tree.slots = aligned_alloc(CACHE_LINE_SIZE, tree.stride * tree.leaves);
+    if (!leaves || !args || !futures || !batch || !tree.arrived ||
+        !tree.slots)
+        goto out;
+    for (size_t i = 0; i < tree.leaves; i++) {
+        leaves[i] = (struct reduce_leaf){ .tree = &tree, .i = i };
+        args[i] = &leaves[i];
+        atomic_init(&tree.arrived[i], 0);
+    }
+
+    size_t added = tpool_batch_add(thrd_pool, batch, reduce_leaf, args,
+                                   tree.leaves, futures);
+    /* what the pool would not take runs here, into the same tree */
+    for (size_t i = added; i < tree.leaves; i++)
+        reduce_leaf(args[i]);
+    tpool_batch_wait(batch);
+    for (size_t i = 0; i < added; i++)
+        tpool_future_destroy(futures[i]);
+    memcpy(result, slot(&tree, 0), reduce->size);
+    ok = true;
+out:
+    free(tree.slots);
+    free(tree.arrived);
+    tpool_batch_destroy(batch);
+    free(futures);
+    free(args);
+    free(leaves);
+    return ok;
+}
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+
+#include "ring.h"
+
+bool ring_init(struct ring *ring, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    ring->slots = malloc(sizeof(struct ring_slot) * size);
+    if (!ring->slots)
+        return false;
+    /* slot i is free for the producer of lap 0 at position i */
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&ring->slots[i].seq, i);
+        ring->slots[i].item = NULL;
+    }
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+void ring_destroy(struct ring *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
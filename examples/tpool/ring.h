@@ -0,0 +1,148 @@
+#ifndef TPOOL_RING_H
+#define TPOOL_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cacheline.h"
+#include "order.h"
+#include "park.h"
+#include "stats.h"
+
+/* Bounded multi-producer, multi-consumer queue of pointers after Dmitry
+ * Vyukov's design. Each slot carries a sequence number that says whose turn
+ * it is: a producer may fill slot i on lap n once its sequence reads
+ * n * capacity + i, and a consumer may empty it once it reads one more than
+ * that. Producers and consumers therefore only contend on their own index, and
+ * a thread that is preempted holding a slot delays only that slot.
+ *
+ * The sequence numbers also carry the items: a release store of one hands
+ * over the item stored before it to whoever reads it with acquire. The
+ * indices only arbitrate between threads of the same side, so every access
+ * to them is relaxed.
+ */
+struct ring_slot {
+    atomic_size_t seq;
+    void *item;
+};
+
+struct ring {
+    /* Producers and consumers each get a line of their own, so a burst of
+     * submissions does not keep stealing the line the workers pop from.
+     */
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;
+    _Alignas(CACHE_LINE_SIZE) size_t mask;
+    struct ring_slot *slots;
+};
+
+/* capacity is rounded up to a power of two */
+bool ring_init(struct ring *ring, size_t capacity);
+void ring_destroy(struct ring *ring);
+
+/* Returns false if the ring is full. */
+static inline bool ring_push(struct ring *ring, void *item)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, mo_relaxed);
+    while (1) {
+        struct ring_slot *slot = &ring->slots[pos & ring->mask];
+        intptr_t dif =
+            (intptr_t)atomic_load_explicit(&slot->seq, mo_acquire) -
+            (intptr_t)pos;
+        if (dif == 0) {
+            /* slot is free on this lap: claim the position */
+            if (atomic_compare_exchange_weak_explicit(
+                    &ring->tail, &pos, pos + 1, mo_relaxed, mo_relaxed)) {
+                slot->item = item;
+                atomic_store_explicit(&slot->seq, pos + 1, mo_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            /* the consumer of the previous lap has not emptied it yet */
+            return false;
+        } else {
+            /* another producer took this position; try the newest one */
+            pos = atomic_load_explicit(&ring->tail, mo_relaxed);
+        }
+    }
+}
+
+/* Push up to n items, item(ctx, i) being the i-th, claiming as many
+ * consecutive positions as there is room for with a single CAS on the tail.
+ * Returns the number pushed, 0 if the ring is full. item is called once per
+ * item pushed and is meant to be inlined, so it should be a plain function.
+ *
+ * Room is judged from the head, which consumers advance when they claim a
+ * slot rather than when they are done with it, so a slot can still be on its
+ * way out when it is reached below. That window is two stores long; wait it
+ * out rather than give the position back.
+ */
+static inline size_t ring_push_n(struct ring *ring,
+                                 void *(*item)(void *, size_t), void *ctx,
+                                 size_t n)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, mo_relaxed), k;
+    while (1) {
+        size_t used = pos - atomic_load_explicit(&ring->head, mo_relaxed);
+        /* a stale tail can fall behind the head; read it again */
+        if (used > ring->mask + 1) {
+            pos = atomic_load_explicit(&ring->tail, mo_relaxed);
+            continue;
+        }
+        k = ring->mask + 1 - used;
+        if (k > n)
+            k = n;
+        if (k == 0)
+            return 0;
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + k,
+                                                  mo_relaxed, mo_relaxed))
+            break;
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        struct ring_slot *slot = &ring->slots[(pos + i) & ring->mask];
+        while (atomic_load_explicit(&slot->seq, mo_acquire) != pos + i)
+            spin_pause();
+        slot->item = item(ctx, i);
+        atomic_store_explicit(&slot->seq, pos + i + 1, mo_release);
+    }
+    return k;
+}
+
+/* Returns NULL if the ring is empty. */
+static inline void *ring_pop(struct ring *ring)
+{
+    size_t pos = atomic_load_explicit(&ring->head, mo_relaxed);
+    while (1) {
+        struct ring_slot *slot = &ring->slots[pos & ring->mask];
+        intptr_t dif =
+            (intptr_t)atomic_load_explicit(&slot->seq, mo_acquire) -
+            (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &ring->head, &pos, pos + 1, mo_relaxed, mo_relaxed)) {
+                void *item = slot->item;
+                /* hand the slot to the producer of the next lap */
+                atomic_store_explicit(&slot->seq, pos + ring->mask + 1,
+                                      mo_release);
+                return item;
+            }
+            stats_count(pop_retries);
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->head, mo_relaxed);
+        }
+    }
+}
+
+/* A snapshot, stale as soon as it is taken; only good as a hint. */
+static inline bool ring_empty(struct ring *ring)
+{
+    return atomic_load_explicit(&ring->head, mo_relaxed) ==
+           atomic_load_explicit(&ring->tail, mo_relaxed);
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "order.h"
+#include "slab.h"
+
+/* Objects are carved out of chunks this big. */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/* A thread's cache holds this many freed objects before it hands them all to
+ * the shared list, so that a thread which only ever frees, such as one that
+ * destroys the futures another thread creates, does not sit on them.
+ */
+#define SLAB_CACHE_MAX 1024
+
+struct slab_chunk {
+    struct slab_chunk *next;
+};
+
+/* A few caches per thread, one per slab it works with. A thread adding jobs
+ * to a list queue allocates a future and a node for each, from two slabs, and
+ * with a single cache would flush it back at every switch. A pool needs at
+ * most three, for its futures, its links and the nodes of all its queues,
+ * whatever its levels and nodes. A thread juggling more slabs than this
+ * still works, only slower.
+ */
+#define SLAB_CACHES 4
+
+struct slab_cache {
+    struct slab *slab;
+    unsigned long id;
+    struct slab_free *list;
+    size_t count; /* objects freed into "list" and not taken back since */
+};
+
+struct slab_caches {
+    struct slab_cache cache[SLAB_CACHES];
+    unsigned int victim; /* the next to give up, round robin */
+    bool registered;     /* with cache_key, to be flushed at thread exit */
+};
+
+static _Thread_local struct slab_caches thread_caches;
+
+/* The live slabs, so that a cache can tell whether the slab it holds objects
+ * of still exists before giving them back. That is only asked when a thread
+ * switches slabs or exits, so a lock is fine.
+ */
+static once_flag registry_once = ONCE_FLAG_INIT;
+static mtx_t registry_lock;
+static struct slab *registry;
+static unsigned long registry_ids;
+static tss_t cache_key; /* only there for its destructor */
+
+static void slab_push_list(struct slab *slab, struct slab_free *first)
+{
+    if (!first)
+        return;
+    struct slab_free *last = first;
+    while (last->next)
+        last = last->next;
+    struct slab_free *head =
+        atomic_load_explicit(&slab->returned, mo_relaxed);
+    do {
+        last->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &slab->returned, &head, first, mo_release, mo_relaxed));
+}
+
+/* Give a cache's objects back if their slab is still around. */
+static void slab_cache_flush(struct slab_cache *c)
+{
+    mtx_lock(&registry_lock);
+    for (struct slab *s = registry; s; s = s->next_live) {
+        if (s == c->slab && s->id == c->id) {
+            slab_push_list(s, c->list);
+            break;
+        }
+    }
+    mtx_unlock(&registry_lock);
+    c->list = NULL;
+    c->count = 0;
+}
+
+static void slab_cache_exit(void *arg)
+{
+    struct slab_caches *caches = arg;
+    for (int i = 0; i < SLAB_CACHES; i++) {
+        if (caches->cache[i].slab)
+            slab_cache_flush(&caches->cache[i]);
+    }
+}
+
+static void registry_init(void)
+{
+    mtx_init(&registry_lock, mtx_plain);
+    tss_create(&cache_key, slab_cache_exit);
+}
+
+/* This thread's cache of slab, if it has one. */
+static struct slab_cache *slab_cache_find(struct slab *slab)
+{
+    for (int i = 0; i < SLAB_CACHES; i++) {
+        struct slab_cache *c = &thread_caches.cache[i];
+        if (c->slab == slab && c->id == slab->id)
+            return c;
+    }
+    return NULL;
+}
+
+static struct slab_cache *slab_cache_get(struct slab *slab)
+{
+    struct slab_cache *c = slab_cache_find(slab);
+    if (c)
+        return c;
+    struct slab_caches *caches = &thread_caches;
+    if (!caches->registered) {
+        tss_set(cache_key, caches); /* first slab this thread has used */
+        caches->registered = true;
+    }
+    /* an unused cache if there is one, otherwise evict one */
+    for (int i = 0; i < SLAB_CACHES && !c; i++) {
+        if (!caches->cache[i].slab)
+            c = &caches->cache[i];
+    }
+    if (!c) {
+        c = &caches->cache[caches->victim++ % SLAB_CACHES];
+        slab_cache_flush(c);
+    }
+    c->slab = slab;
+    c->id = slab->id;
+    return c;
+}
+
+bool slab_init(struct slab *slab, size_t size, size_t align)
+{
+    if (align < _Alignof(struct slab_free))
+        align = _Alignof(struct slab_free);
+    if (size < sizeof(struct slab_free))
+        size = sizeof(struct slab_free);
+    slab->size = (size + align - 1) / align * align;
+    slab->align = align;
+    if (slab->size > SLAB_CHUNK_SIZE / 2)
+        return false;
+    if (mtx_init(&slab->lock, mtx_plain) != thrd_success)
+        return false;
+    slab->chunks = NULL;
+    atomic_init(&slab->returned, NULL);
+
+    call_once(&registry_once, registry_init);
+    mtx_lock(&registry_lock);
+    slab->id = ++registry_ids;
+    slab->next_live = registry;
+    registry = slab;
+    mtx_unlock(&registry_lock);
+    return true;
+}
+
+void slab_destroy(struct slab *slab)
+{
+    mtx_lock(&registry_lock);
+    for (struct slab **p = &registry; *p; p = &(*p)->next_live) {
+        if (*p == slab) {
+            *p = slab->next_live;
+            break;
+        }
+    }
+    mtx_unlock(&registry_lock);
+
+    /* Other threads drop their caches of this slab the next time they look */
+    struct slab_cache *c = slab_cache_find(slab);
+    if (c) {
+        c->list = NULL;
+        c->count = 0;
+        c->id = 0;
+    }
+
+    struct slab_chunk *chunk = slab->chunks;
+    while (chunk) {
+        struct slab_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    mtx_destroy(&slab->lock);
+}
+
+/* Carve a new chunk into the cache, which is empty. */
+static bool slab_grow(struct slab *slab, struct slab_cache *c)
+{
+    size_t align =
+        slab->align > CACHE_LINE_SIZE ? slab->align : CACHE_LINE_SIZE;
+    struct slab_chunk *chunk = aligned_alloc(align, SLAB_CHUNK_SIZE);
+    if (!chunk)
+        return false;
+    mtx_lock(&slab->lock);
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    mtx_unlock(&slab->lock);
+
+    /* Link the objects in address order, so that they are handed out in it */
+    uintptr_t start = (uintptr_t)chunk + sizeof(*chunk);
+    start = (start + slab->align - 1) / slab->align * slab->align;
+    uintptr_t end = (uintptr_t)chunk + SLAB_CHUNK_SIZE;
+    struct slab_free **tail = &c->list;
+    for (uintptr_t p = start; p + slab->size <= end; p += slab->size) {
+        *tail = (struct slab_free *)p;
+        tail = &(*tail)->next;
+    }
+    *tail = NULL;
+    return true;
+}
+
+void *slab_alloc(struct slab *slab)
+{
+    struct slab_cache *c = slab_cache_get(slab);
+    if (!c->list) {
+        c->list = atomic_exchange_explicit(&slab->returned, NULL, mo_acquire);
+        if (!c->list && !slab_grow(slab, c))
+            return NULL;
+    }
+    struct slab_free *obj = c->list;
+    c->list = obj->next;
+    if (c->count)
+        c->count--;
+    return obj;
+}
+
+void slab_free(struct slab *slab, void *obj)
+{
+    struct slab_free *node = obj;
+    struct slab_cache *c = slab_cache_find(slab);
+    if (!c) {
+        /* Not ours to cache: give it straight back */
+        node->next = NULL;
+        slab_push_list(slab, node);
+        return;
+    }
+    node->next = c->list;
+    c->list = node;
+    if (++c->count > SLAB_CACHE_MAX) {
+        slab_push_list(slab, c->list);
+        c->list = NULL;
+        c->count = 0;
+    }
+}
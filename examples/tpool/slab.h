@@ -0,0 +1,45 @@
+#ifndef TPOOL_SLAB_H
+#define TPOOL_SLAB_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+#include "cacheline.h"
+
+/* Fixed-size object allocator. Objects are carved out of large chunks that
+ * are only returned to the system when the slab is destroyed, and each thread
+ * keeps the objects it frees in a cache of its own to hand straight back to
+ * its next allocation. In the steady state, where the same threads allocate
+ * and free, neither touches the heap nor any shared cache line.
+ *
+ * An object freed by a thread with no cache for its slab goes onto a shared
+ * list instead. Pushing there is one CAS, and the only way objects
+ * come off is a thread swapping the whole list out for its cache. Nobody ever
+ * pops a single node, so the list has no ABA problem to solve.
+ */
+struct slab_free {
+    struct slab_free *next;
+};
+
+struct slab_chunk;
+
+struct slab {
+    size_t size;  /* bytes per object, a multiple of align */
+    size_t align; /* alignment of every object */
+    unsigned long id; /* tells thread caches apart from a reused address */
+    struct slab *next_live;
+    _Alignas(CACHE_LINE_SIZE) _Atomic(struct slab_free *) returned;
+    _Alignas(CACHE_LINE_SIZE) mtx_t lock; /* guards "chunks" */
+    struct slab_chunk *chunks;
+};
+
+bool slab_init(struct slab *slab, size_t size, size_t align);
+/* Every object goes away with the slab, whoever still holds it. */
+void slab_destroy(struct slab *slab);
+
+void *slab_alloc(struct slab *slab);
+void slab_free(struct slab *slab, void *obj);
+
+#endif
@@ -0,0 +1,45 @@
+#include <stdlib.h>
+
+#include "spinlock.h"
+
+static struct clh_node *clh_node_create(void)
+{
+    struct clh_node *node =
+        aligned_alloc(_Alignof(struct clh_node), sizeof(struct clh_node));
+    if (node)
+        atomic_init(&node->locked, false);
+    return node;
+}
+
+/* The lock starts out with a node of its own, released, for the first comer
+ * to spin on.
+ */
+bool clh_init(struct clh_lock *l)
+{
+    struct clh_node *node = clh_node_create();
+    if (!node)
+        return false;
+    atomic_init(&l->tail, node);
+    return true;
+}
+
+/* With nobody holding the lock, the nodes still in the handles and the one
+ * at the tail are all different ones, each freed once.
+ */
+void clh_destroy(struct clh_lock *l)
+{
+    free(atomic_load_explicit(&l->tail, mo_relaxed));
+}
+
+bool clh_handle_init(struct clh_handle *h)
+{
+    h->node = clh_node_create();
+    h->pred = NULL;
+    return h->node;
+}
+
+void clh_handle_destroy(struct clh_handle *h)
+{
+    free(h->node);
+    h->node = NULL;
+}
@@ -0,0 +1,220 @@
+#ifndef TPOOL_SPINLOCK_H
+#define TPOOL_SPINLOCK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <threads.h>
+
+#include "cacheline.h"
+#include "order.h"
+#include "park.h"
+
+/* The locks of the manuscript's "Test and set" section and the queue locks
+ * that grew out of them, smallest first:
+ *
+ *     tas     one flag everybody exchanges; every spin is a write, so the
+ *             line holding it bounces between the waiters the whole time
+ *     ttas    test and test-and-set: spin reading, which stays in the own
+ *             cache, and back off exponentially after losing a race
+ *     ticket  take a number and wait to be served: first come, first served,
+ *             though every waiter still polls the one counter
+ *     mcs     each waiter spins on a node of its own, linked into a queue;
+ *             the holder hands the lock to the next one directly
+ *     clh     the same with an implicit queue: each waiter spins on the node
+ *             of the one ahead, and takes that node over when done
+ *
+ * All of them spin with spin_pause, and give the CPU up every LOCK_SPIN_LIMIT
+ * rounds: a waiter that spins through the time slice of a holder which is not
+ * running only keeps it from running. The queue locks suffer most from that,
+ * since the lock goes to the next in line whether or not it runs.
+ */
+#define LOCK_SPIN_LIMIT 1024
+
+static inline void lock_relax(int *spins)
+{
+    if (++*spins % LOCK_SPIN_LIMIT)
+        spin_pause();
+    else
+        thrd_yield();
+}
+
+struct tas_lock {
+    atomic_bool locked;
+};
+
+static inline void tas_init(struct tas_lock *l)
+{
+    atomic_init(&l->locked, false);
+}
+
+static inline void tas_acquire(struct tas_lock *l)
+{
+    int spins = 0;
+    while (atomic_exchange_explicit(&l->locked, true, mo_acquire))
+        lock_relax(&spins);
+}
+
+static inline void tas_release(struct tas_lock *l)
+{
+    atomic_store_explicit(&l->locked, false, mo_release);
+}
+
+/* Backoff from TTAS_BACKOFF_MIN pauses, doubling after each lost race up to
+ * TTAS_BACKOFF_MAX: losers spread out instead of all rushing the line the
+ * moment it is released.
+ */
+#define TTAS_BACKOFF_MIN 4
+#define TTAS_BACKOFF_MAX 1024
+
+struct ttas_lock {
+    atomic_bool locked;
+};
+
+static inline void ttas_init(struct ttas_lock *l)
+{
+    atomic_init(&l->locked, false);
+}
+
+static inline void ttas_acquire(struct ttas_lock *l)
+{
+    int spins = 0, backoff = TTAS_BACKOFF_MIN;
+    while (1) {
+        while (atomic_load_explicit(&l->locked, mo_relaxed))
+            lock_relax(&spins);
+        if (!atomic_exchange_explicit(&l->locked, true, mo_acquire))
+            return;
+        for (int i = 0; i < backoff; i++)
+            lock_relax(&spins);
+        if (backoff < TTAS_BACKOFF_MAX)
+            backoff *= 2;
+    }
+}
+
+static inline void ttas_release(struct ttas_lock *l)
+{
+    atomic_store_explicit(&l->locked, false, mo_release);
+}
+
+struct ticket_lock {
+    atomic_uint next;    /* the number the next comer takes */
+    atomic_uint serving; /* the number that holds the lock */
+};
+
+static inline void ticket_init(struct ticket_lock *l)
+{
+    atomic_init(&l->next, 0);
+    atomic_init(&l->serving, 0);
+}
+
+static inline void ticket_acquire(struct ticket_lock *l)
+{
+    unsigned int ticket =
+        atomic_fetch_add_explicit(&l->next, 1, mo_relaxed);
+    int spins = 0;
+    while (atomic_load_explicit(&l->serving, mo_acquire) != ticket)
+        lock_relax(&spins);
+}
+
+/* Only the holder writes "serving", so a plain load and store will do. */
+static inline void ticket_release(struct ticket_lock *l)
+{
+    unsigned int ticket = atomic_load_explicit(&l->serving, mo_relaxed);
+    atomic_store_explicit(&l->serving, ticket + 1, mo_release);
+}
+
+/* A waiter's place in an MCS queue, which the caller provides, typically on
+ * its stack, and keeps until it has released the lock again. A line of its
+ * own, so that spinning on it disturbs nobody.
+ */
+struct mcs_node {
+    _Alignas(CACHE_LINE_SIZE) _Atomic(struct mcs_node *) next;
+    atomic_bool locked;
+};
+
+struct mcs_lock {
+    _Atomic(struct mcs_node *) tail;
+};
+
+static inline void mcs_init(struct mcs_lock *l)
+{
+    atomic_init(&l->tail, NULL);
+}
+
+static inline void mcs_acquire(struct mcs_lock *l, struct mcs_node *node)
+{
+    atomic_init(&node->next, NULL);
+    atomic_init(&node->locked, true);
+    /* acq_rel: the node is set up before the one ahead can reach it, and what
+     * the previous holder did is seen if the queue was empty
+     */
+    struct mcs_node *prev =
+        atomic_exchange_explicit(&l->tail, node, mo_acq_rel);
+    if (!prev)
+        return;
+    atomic_store_explicit(&prev->next, node, mo_release);
+    int spins = 0;
+    while (atomic_load_explicit(&node->locked, mo_acquire))
+        lock_relax(&spins);
+}
+
+static inline void mcs_release(struct mcs_lock *l, struct mcs_node *node)
+{
+    struct mcs_node *next = atomic_load_explicit(&node->next, mo_acquire);
+    if (!next) {
+        /* nobody behind us: empty the queue, unless somebody just joined */
+        struct mcs_node *expected = node;
+        if (atomic_compare_exchange_strong_explicit(
+                &l->tail, &expected, NULL, mo_release, mo_relaxed))
+            return;
+        /* they have swapped the tail but not linked themselves in yet */
+        int spins = 0;
+        while (!(next = atomic_load_explicit(&node->next, mo_acquire)))
+            lock_relax(&spins);
+    }
+    atomic_store_explicit(&next->locked, false, mo_release);
+}
+
+/* CLH nodes move from thread to thread: releasing the lock leaves the own
+ * node to the one behind, and takes over the node of the one ahead. So a
+ * node cannot live on a stack; each thread has a handle holding the node it
+ * owns at the moment, and the lock holds one more.
+ */
+struct clh_node {
+    _Alignas(CACHE_LINE_SIZE) atomic_bool locked;
+};
+
+struct clh_lock {
+    _Atomic(struct clh_node *) tail;
+};
+
+struct clh_handle {
+    struct clh_node *node; /* owned */
+    struct clh_node *pred; /* spun on, and owned after the release */
+};
+
+/* Return false if out of memory. */
+bool clh_init(struct clh_lock *l);
+void clh_destroy(struct clh_lock *l);
+bool clh_handle_init(struct clh_handle *h);
+void clh_handle_destroy(struct clh_handle *h);
+
+static inline void clh_acquire(struct clh_lock *l, struct clh_handle *h)
+{
+    atomic_store_explicit(&h->node->locked, true, mo_relaxed);
+    /* acq_rel: our "locked" is set before the one behind can see the node,
+     * and the node ahead is seen as its owner left it
+     */
+    h->pred = atomic_exchange_explicit(&l->tail, h->node, mo_acq_rel);
+    int spins = 0;
+    while (atomic_load_explicit(&h->pred->locked, mo_acquire))
+        lock_relax(&spins);
+}
+
+static inline void clh_release(struct clh_handle *h)
+{
+    struct clh_node *node = h->node;
+    h->node = h->pred;
+    atomic_store_explicit(&node->locked, false, mo_release);
+}
+
+#endif
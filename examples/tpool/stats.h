@@ -0,0 +1,136 @@
+#ifndef TPOOL_STATS_H
+#define TPOOL_STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cacheline.h"
+#include "order.h"
+
+/* Counters for what the pool's threads spend their time on. They cost a
+ * clock read or two per job and some stores to lines nobody else writes,
+ * which is too much to pay unasked, so they only exist in a build with
+ * -DTPOOL_STATS. Otherwise every counting site below compiles to nothing, the
+ * pool carries no counters, and tpool_stats_snapshot says there are none.
+ */
+
+/* Histograms are over powers of two of nanoseconds: bucket i counts times in
+ * [2^i, 2^(i+1)) ns, and the last one everything from about two seconds up.
+ */
+#define TPOOL_STATS_BUCKETS 32
+
+/* What tpool_stats_snapshot adds up over the whole pool. */
+struct tpool_stats {
+    unsigned long jobs;        /* jobs run */
+    unsigned long steals;      /* of those, taken from another worker */
+    unsigned long pop_retries; /* CAS lost to another thread taking a job */
+    unsigned long spins;       /* polls of an idle worker before it parks */
+    unsigned long yields;      /* thrd_yield calls of an idle worker */
+    unsigned long parks;       /* times an idle worker went to sleep */
+    unsigned long idle_ns;     /* time spent in those yields and sleeps */
+    /* from add_job to the job starting, and from there to it returning */
+    unsigned long queue_wait[TPOOL_STATS_BUCKETS];
+    unsigned long run_time[TPOOL_STATS_BUCKETS];
+};
+
+/* The upper end, in ns, of the bucket holding the p-th percentile. */
+static inline uint64_t tpool_stats_percentile(const unsigned long *hist,
+                                              double p)
+{
+    unsigned long total = 0, seen = 0;
+    for (int i = 0; i < TPOOL_STATS_BUCKETS; i++)
+        total += hist[i];
+    for (int i = 0; i < TPOOL_STATS_BUCKETS; i++) {
+        seen += hist[i];
+        if (total && seen >= p / 100.0 * total)
+            return (uint64_t)2 << i;
+    }
+    return 0;
+}
+
+#ifdef TPOOL_STATS
+/* The live counters behind a snapshot. Each worker has its own on lines of
+ * their own, and is the only one writing them, so counting is a load and a
+ * store rather than a read-modify-write. Only the counters for threads
+ * outside the pool are shared, and they are rarely hit.
+ */
+struct stats_counters {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong jobs;
+    atomic_ulong steals;
+    atomic_ulong pop_retries;
+    atomic_ulong spins;
+    atomic_ulong yields;
+    atomic_ulong parks;
+    atomic_ulong idle_ns;
+    bool shared;
+    atomic_ulong queue_wait[TPOOL_STATS_BUCKETS];
+    atomic_ulong run_time[TPOOL_STATS_BUCKETS];
+};
+
+/* The counters of the worker the calling thread is, NULL for any other,
+ * while it is not popping from a shared queue; see stats_count below.
+ */
+extern _Thread_local struct stats_counters *stats_self;
+
+static inline void stats_init(struct stats_counters *c, bool shared)
+{
+    atomic_init(&c->jobs, 0);
+    atomic_init(&c->steals, 0);
+    atomic_init(&c->pop_retries, 0);
+    atomic_init(&c->spins, 0);
+    atomic_init(&c->yields, 0);
+    atomic_init(&c->parks, 0);
+    atomic_init(&c->idle_ns, 0);
+    c->shared = shared;
+    for (int i = 0; i < TPOOL_STATS_BUCKETS; i++) {
+        atomic_init(&c->queue_wait[i], 0);
+        atomic_init(&c->run_time[i], 0);
+    }
+}
+
+static inline void stats_bump(bool shared, atomic_ulong *counter,
+                              unsigned long n)
+{
+    if (shared)
+        atomic_fetch_add_explicit(counter, n, mo_relaxed);
+    else
+        atomic_store_explicit(
+            counter, atomic_load_explicit(counter, mo_relaxed) + n,
+            mo_relaxed);
+}
+
+#define stats_add(c, field, n) stats_bump((c)->shared, &(c)->field, (n))
+
+static inline void stats_record(struct stats_counters *c, atomic_ulong *hist,
+                                uint64_t ns)
+{
+    int b = 0;
+    while ((ns >>= 1) && b < TPOOL_STATS_BUCKETS - 1)
+        b++;
+    stats_bump(c->shared, &hist[b], 1);
+}
+
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* For the queues and deques, which do not know whose pool they are in:
+ * count against stats_self, and not at all where it is NULL. Around a pop
+ * from a pool's shared queue, stats_self is what the caller does for that
+ * pool, so a worker of one pool popping from another's is counted there.
+ */
+#define stats_count(field)                   \
+    do {                                     \
+        if (stats_self)                      \
+            stats_add(stats_self, field, 1); \
+    } while (0)
+#else
+#define stats_count(field) ((void)0)
+#endif
+
+#endif
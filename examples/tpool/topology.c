@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "topology.h"
+
+static bool topology_alloc(struct topology *topo, int nnodes, int ncpus,
+                           int nids)
+{
+    topo->nnodes = nnodes;
+    topo->ncpus = 0;
+    topo->nids = nids;
+    topo->cpus = malloc(sizeof(int) * (ncpus ? ncpus : 1));
+    topo->first = malloc(sizeof(int) * (nnodes + 1));
+    topo->node_of = malloc(sizeof(int) * (nids ? nids : 1));
+    if (!topo->cpus || !topo->first || !topo->node_of) {
+        topology_destroy(topo);
+        return false;
+    }
+    for (int i = 0; i < nids; i++)
+        topo->node_of[i] = -1;
+    topo->first[0] = 0;
+    return true;
+}
+
+/* nodes made up out of the n CPUs in ids[], which are in ascending order */
+static bool topology_make(struct topology *topo, const int *ids, int n,
+                          int nodes)
+{
+    int nids = n ? ids[n - 1] + 1 : 0;
+    /* a node left without CPUs of its own borrows one */
+    if (!topology_alloc(topo, nodes, n + nodes, nids))
+        return false;
+    for (int k = 0; k < nodes; k++) {
+        int begin = (int)((long)k * n / nodes);
+        int end = (int)((long)(k + 1) * n / nodes);
+        for (int i = begin; i < end; i++) {
+            topo->cpus[topo->ncpus++] = ids[i];
+            topo->node_of[ids[i]] = k;
+        }
+        if (begin == end)
+            topo->cpus[topo->ncpus++] = n ? ids[k % n] : 0;
+        topo->first[k + 1] = topo->ncpus;
+    }
+    return true;
+}
+
+void topology_destroy(struct topology *topo)
+{
+    free(topo->node_of);
+    free(topo->first);
+    free(topo->cpus);
+    topo->node_of = topo->first = topo->cpus = NULL;
+}
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define NODE_DIR "/sys/devices/system/node"
+
+/* Mark the CPUs of a sysfs list such as "0-3,8-11" in set. */
+static bool read_cpulist(const char *path, cpu_set_t *set)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    CPU_ZERO(set);
+    int lo, hi;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return true;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* The real nodes, those with any CPU in allowed, or false if sysfs has none
+ * to offer.
+ */
+static bool topology_read(struct topology *topo, const cpu_set_t *allowed,
+                          int nids)
+{
+    int ids[CPU_SETSIZE], n = 0;
+    DIR *dir = opendir(NODE_DIR);
+    if (!dir)
+        return false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) && n < CPU_SETSIZE) {
+        int id;
+        char end;
+        if (sscanf(entry->d_name, "node%d%c", &id, &end) == 1)
+            ids[n++] = id;
+    }
+    closedir(dir);
+    qsort(ids, n, sizeof(int), cmp_int);
+
+    cpu_set_t *sets = malloc(sizeof(cpu_set_t) * (n ? n : 1));
+    if (!sets)
+        return false;
+    int nnodes = 0, ncpus = 0;
+    for (int k = 0; k < n; k++) {
+        char path[64];
+        snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", ids[k]);
+        if (!read_cpulist(path, &sets[nnodes]))
+            continue;
+        CPU_AND(&sets[nnodes], &sets[nnodes], allowed);
+        /* a node of memory only has nothing to run workers on */
+        if (CPU_COUNT(&sets[nnodes])) {
+            ncpus += CPU_COUNT(&sets[nnodes]);
+            nnodes++;
+        }
+    }
+    if (!nnodes || !topology_alloc(topo, nnodes, ncpus, nids)) {
+        free(sets);
+        return false;
+    }
+    for (int k = 0; k < nnodes; k++) {
+        for (int cpu = 0; cpu < nids; cpu++) {
+            if (CPU_ISSET(cpu, &sets[k]) && topo->node_of[cpu] < 0 &&
+                topo->ncpus < ncpus) {
+                topo->cpus[topo->ncpus++] = cpu;
+                topo->node_of[cpu] = k;
+            }
+        }
+        topo->first[k + 1] = topo->ncpus;
+    }
+    free(sets);
+    return true;
+}
+
+bool topology_init(struct topology *topo, int nodes)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+    int ids[CPU_SETSIZE], n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed))
+            ids[n++] = cpu;
+    }
+    if (!nodes && topology_read(topo, &allowed, n ? ids[n - 1] + 1 : 0))
+        return true;
+    return topology_make(topo, ids, n, nodes > 0 ? nodes : 1);
+}
+
+int topology_current_node(const struct topology *topo)
+{
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= topo->nids || topo->node_of[cpu] < 0)
+        return 0;
+    return topo->node_of[cpu];
+}
+
+bool topology_pin(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !sched_setaffinity(0, sizeof(set), &set);
+}
+
+#else
+/* No way to tell CPUs apart: one of them, on as many nodes as asked for. */
+bool topology_init(struct topology *topo, int nodes)
+{
+    static const int ids[] = { 0 };
+    return topology_make(topo, ids, 1, nodes > 0 ? nodes : 1);
+}
+
+int topology_current_node(const struct topology *topo)
+{
+    (void)topo;
+    return 0;
+}
+
+bool topology_pin(int cpu)
+{
+    (void)cpu;
+    return false;
+}
+#endif
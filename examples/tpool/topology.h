@@ -0,0 +1,37 @@
+#ifndef TPOOL_TOPOLOGY_H
+#define TPOOL_TOPOLOGY_H
+
+#include <stdbool.h>
+
+/* The CPUs the process may run on, grouped by the NUMA node each belongs to.
+ * Linux lists the nodes in sysfs; anywhere else, or if that fails, it is one
+ * node of whatever CPUs there are.
+ *
+ * A topology can also be made up: asked for a given number of nodes, it
+ * splits the CPUs into that many runs of consecutive ones, or hands the same
+ * CPUs out again when there are fewer CPUs than nodes. That is how the
+ * per-node paths get exercised on a machine with a single node, or a single
+ * CPU.
+ */
+struct topology {
+    int nnodes;
+    int ncpus; /* in cpus[], which may list a CPU more than once */
+    int *cpus; /* node by node: node k has cpus[first[k]] to first[k + 1] */
+    int *first;
+    int nids;     /* entries in node_of */
+    int *node_of; /* node by CPU id, -1 for CPUs the process may not use */
+};
+
+/* nodes is the number of nodes to make up, or 0 for the real ones. */
+bool topology_init(struct topology *topo, int nodes);
+void topology_destroy(struct topology *topo);
+
+/* The node of the CPU the caller runs on right now, 0 if unknown. */
+int topology_current_node(const struct topology *topo);
+
+/* Keep the calling thread on the given CPU. Returns false where that is not
+ * supported.
+ */
+bool topology_pin(int cpu);
+
+#endif
@@ -0,0 +1,1520 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fiber.h"
+#include "order.h"
+#include "park.h"
+#include "tpool.h"
+
+/* Rounds a waiter polls before it parks. A parked thread costs a system call
+ * and a trip through the scheduler to wake, a few microseconds, so spinning
+ * for about as long first keeps back-to-back jobs off that path entirely.
+ */
+#define TPOOL_SPIN_LIMIT 1024
+
+/* Initial deque size under TPOOL_SCHED_STEAL; deques grow as needed. */
+#define TPOOL_DEQUE_SIZE 256
+
+/* The worker the calling thread is, if it is one, so that add_job and
+ * tpool_future_wait can tell a job's own calls from outside ones.
+ */
+static _Thread_local struct tpool_worker *current_worker;
+
+/* The job the calling thread is running, for tpool_result_alloc. */
+static _Thread_local struct tpool_future *current_job;
+
+#ifdef TPOOL_STATS
+_Thread_local struct stats_counters *stats_self;
+
+/* where what the calling thread does for thrd_pool is counted */
+static struct stats_counters *stats_of(tpool_t *thrd_pool)
+{
+    struct tpool_worker *self = current_worker;
+    if (self && self->pool == thrd_pool)
+        return &self->stats;
+    return &thrd_pool->outside;
+}
+#endif
+
+/* The calling worker's slot of "pending", the shared one for other threads. */
+static int pending_slot(tpool_t *thrd_pool)
+{
+    struct tpool_worker *self = current_worker;
+    if (self && self->pool == thrd_pool)
+        return (int)(self - thrd_pool->workers);
+    return COUNTER_SHARED;
+}
+
+/* A future is pending until its job returns. A waiter that gives up spinning
+ * moves it to "sleeping" first, so the worker finishing the job knows there is
+ * somebody to wake and skips the system call when there is not.
+ */
+enum { FUTURE_DONE, FUTURE_PENDING, FUTURE_SLEEPING };
+
+/* set in a batch word whose waiter sleeps on it */
+#define BATCH_SLEEPING INT_MIN
+/* set in a batch word whose waiter's fiber stopped on it, until handed back */
+#define BATCH_FIBER (1 << TPOOL_BATCH_BITS)
+
+static void run_job(tpool_t *thrd_pool, struct tpool_future *job);
+
+static struct tpool_future *future_create(tpool_t *thrd_pool,
+                                          void *(*func)(void *), void *arg)
+{
+    struct tpool_future *future = slab_alloc(&thrd_pool->futures);
+    if (!future)
+        return NULL;
+    future->func = func;
+    future->arg = arg;
+    future->result = NULL;
+    future->pool = thrd_pool;
+    atomic_init(&future->links, NULL);
+    atomic_init(&future->state, FUTURE_PENDING);
+#ifdef TPOOL_STATS
+    future->added = stats_now();
+#endif
+    return future;
+}
+
+void tpool_future_destroy(struct tpool_future *future)
+{
+    if (future->result != future->inline_result)
+        free(future->result);
+    slab_free(&future->pool->futures, future);
+}
+
+void *tpool_result_alloc(size_t size)
+{
+    struct tpool_future *job = current_job;
+    if (job && size <= sizeof(job->inline_result))
+        return job->inline_result;
+    return malloc(size);
+}
+
+/* for how long a surplus worker has been idle */
+static uint64_t clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The configuration, for one of the pool's workers, which reads it between
+ * quiescent states, or for a thread holding grow_lock.
+ */
+static struct tpool_config *tpool_config(tpool_t *thrd_pool)
+{
+    return qsbr_read(&thrd_pool->config);
+}
+
+static void config_free(struct qsbr_node *node)
+{
+    free((struct tpool_config *)node);
+}
+
+/* Start one more worker, or wake one that retired, if there are jobs that no
+ * running worker is free to take and the target allows. A thread that finds
+ * the lock taken leaves it to whoever holds it.
+ */
+static void tpool_grow(tpool_t *thrd_pool)
+{
+    struct tpool_worker *self = current_worker;
+    int active = atomic_load_explicit(&thrd_pool->active, mo_relaxed);
+    /* only a worker may look at the target before taking the lock */
+    if ((self && self->pool == thrd_pool &&
+         active >= tpool_config(thrd_pool)->target) ||
+        counter_read(&thrd_pool->pending) <= active ||
+        mtx_trylock(&thrd_pool->grow_lock) != thrd_success)
+        return;
+    active = atomic_load_explicit(&thrd_pool->active, mo_relaxed);
+    int started = atomic_load_explicit(&thrd_pool->started, mo_relaxed);
+    if (active < tpool_config(thrd_pool)->target &&
+        atomic_load_explicit(&thrd_pool->state, mo_relaxed) == running) {
+        /* the new thread counts as retired until "active" takes it in */
+        if (active == started &&
+            thrd_create(&thrd_pool->pool[started], thrd_pool->func,
+                        &thrd_pool->workers[started]) == thrd_success)
+            atomic_store_explicit(&thrd_pool->started, ++started, mo_relaxed);
+        /* A worker may retire meanwhile, and then the CAS fails and the pool
+         * stays as it is: the next job added tries again.
+         */
+        if (active < started &&
+            atomic_compare_exchange_strong_explicit(&thrd_pool->active,
+                                                    &active, active + 1,
+                                                    mo_relaxed, mo_relaxed)) {
+            atomic_fetch_add_explicit(&thrd_pool->resize, 1, mo_release);
+            park_wake(&thrd_pool->resize, INT_MAX);
+        }
+    }
+    mtx_unlock(&thrd_pool->grow_lock);
+}
+
+/* Wake up to n parked workers. Bumping "signal" is what makes a worker that
+ * is just about to park notice: it compares against the value it read before
+ * counting itself in.
+ *
+ * The work was published before the call and "parked" is read after it, a
+ * store followed by a load, which only a full fence keeps in that order. The
+ * worker about to park has the mirror image of it. With none parked, the
+ * pool grows instead, if it may.
+ */
+static void tpool_wake(tpool_t *thrd_pool, int n)
+{
+    atomic_thread_fence(mo_seq_cst);
+    if (atomic_load_explicit(&thrd_pool->parked, mo_relaxed)) {
+        atomic_fetch_add_explicit(&thrd_pool->signal, 1, mo_release);
+        park_wake(&thrd_pool->signal, n);
+    } else if (thrd_pool->min < thrd_pool->size) {
+        /* every running worker is busy */
+        tpool_grow(thrd_pool);
+    }
+}
+
+/* The shared queues, one per node and level, whichever kind they are */
+static struct tpool_level *level_at(tpool_t *thrd_pool, int node, int level)
+{
+    return &thrd_pool->levels[node * thrd_pool->nlevels + level];
+}
+
+/* Pushes return false when full. */
+static bool queue_push(tpool_t *thrd_pool, int node, int level,
+                       struct tpool_future *future)
+{
+    struct tpool_level *l = level_at(thrd_pool, node, level);
+    switch (thrd_pool->queue) {
+    case TPOOL_QUEUE_LIST:
+        return lfqueue_push(&l->list, future);
+    case TPOOL_QUEUE_MUTEX:
+    case TPOOL_QUEUE_SPIN:
+        return lockqueue_push(&l->locked, future);
+    default:
+        return ring_push(&l->ring, future);
+    }
+}
+
+static size_t queue_push_n(tpool_t *thrd_pool, int node, int level,
+                           void *(*item)(void *, size_t), void *ctx, size_t n)
+{
+    struct tpool_level *l = level_at(thrd_pool, node, level);
+    switch (thrd_pool->queue) {
+    case TPOOL_QUEUE_LIST:
+        return lfqueue_push_n(&l->list, item, ctx, n);
+    case TPOOL_QUEUE_MUTEX:
+    case TPOOL_QUEUE_SPIN:
+        return lockqueue_push_n(&l->locked, item, ctx, n);
+    default:
+        return ring_push_n(&l->ring, item, ctx, n);
+    }
+}
+
+static struct tpool_future *level_pop(tpool_t *thrd_pool, int node,
+                                      int level)
+{
+    struct tpool_level *l = level_at(thrd_pool, node, level);
+    struct tpool_future *job;
+#ifdef TPOOL_STATS
+    /* A worker of another pool that adds or helps here must not charge the
+     * retries to its own counters.
+     */
+    struct stats_counters *saved = stats_self;
+    stats_self = stats_of(thrd_pool);
+#endif
+    switch (thrd_pool->queue) {
+    case TPOOL_QUEUE_LIST:
+        job = lfqueue_pop(&l->list);
+        break;
+    case TPOOL_QUEUE_MUTEX:
+    case TPOOL_QUEUE_SPIN:
+        job = lockqueue_pop(&l->locked);
+        break;
+    default:
+        job = ring_pop(&l->ring);
+    }
+#ifdef TPOOL_STATS
+    stats_self = saved;
+#endif
+    return job;
+}
+
+/* a job of the level from the node's own queue, or failing that, the others */
+static struct tpool_future *level_pop_near(tpool_t *thrd_pool, int node,
+                                           int level)
+{
+    struct tpool_future *job = NULL;
+    int nnodes = thrd_pool->topology.nnodes;
+    for (int i = 0; i < nnodes && !job; i++)
+        job = level_pop(thrd_pool, (node + i) % nnodes, level);
+    return job;
+}
+
+/* the most urgent job on any shared queue */
+static struct tpool_future *queue_pop(tpool_t *thrd_pool)
+{
+    struct tpool_future *job = NULL;
+    for (int i = 0; i < thrd_pool->nlevels && !job; i++)
+        job = level_pop_near(thrd_pool, 0, i);
+    return job;
+}
+
+static bool level_empty(tpool_t *thrd_pool, struct tpool_level *l)
+{
+    switch (thrd_pool->queue) {
+    case TPOOL_QUEUE_LIST:
+        return lfqueue_empty(&l->list);
+    case TPOOL_QUEUE_MUTEX:
+    case TPOOL_QUEUE_SPIN:
+        return lockqueue_empty(&l->locked);
+    default:
+        return ring_empty(&l->ring);
+    }
+}
+
+static bool queue_empty(tpool_t *thrd_pool)
+{
+    int n = thrd_pool->topology.nnodes * thrd_pool->nlevels;
+    for (int i = 0; i < n; i++) {
+        if (!level_empty(thrd_pool, &thrd_pool->levels[i]))
+            return false;
+    }
+    return true;
+}
+
+/* Destroy the first n queues, and the topology they were laid out by. */
+static void queue_destroy_levels(tpool_t *thrd_pool, int n)
+{
+    for (int i = 0; i < n; i++) {
+        struct tpool_level *l = &thrd_pool->levels[i];
+        switch (thrd_pool->queue) {
+        case TPOOL_QUEUE_LIST:
+            lfqueue_destroy(&l->list);
+            break;
+        case TPOOL_QUEUE_MUTEX:
+        case TPOOL_QUEUE_SPIN:
+            lockqueue_destroy(&l->locked);
+            break;
+        default:
+            ring_destroy(&l->ring);
+        }
+    }
+    free(thrd_pool->levels);
+    thrd_pool->levels = NULL;
+    if (thrd_pool->queue == TPOOL_QUEUE_LIST)
+        slab_destroy(&thrd_pool->list_nodes);
+    topology_destroy(&thrd_pool->topology);
+}
+
+static bool queue_init(tpool_t *thrd_pool)
+{
+    if (!topology_init(&thrd_pool->topology, thrd_pool->nodes))
+        return false;
+    thrd_pool->nlevels = thrd_pool->priorities > 1 ? thrd_pool->priorities : 1;
+    int n = thrd_pool->topology.nnodes * thrd_pool->nlevels;
+    /* One slab for the nodes of every level on every node: a thread that
+     * adds and takes jobs at all levels then keeps one cache of nodes rather
+     * than one per queue, and stays within its few slab caches.
+     */
+    if (thrd_pool->queue == TPOOL_QUEUE_LIST &&
+        !slab_init(&thrd_pool->list_nodes, sizeof(struct lfq_node),
+                   _Alignof(struct lfq_node))) {
+        topology_destroy(&thrd_pool->topology);
+        return false;
+    }
+    thrd_pool->levels = aligned_alloc(_Alignof(struct tpool_level),
+                                      sizeof(struct tpool_level) * n);
+    if (!thrd_pool->levels) {
+        if (thrd_pool->queue == TPOOL_QUEUE_LIST)
+            slab_destroy(&thrd_pool->list_nodes);
+        topology_destroy(&thrd_pool->topology);
+        return false;
+    }
+    size_t capacity = thrd_pool->capacity ? thrd_pool->capacity
+                                          : TPOOL_CAPACITY;
+    for (int i = 0; i < n; i++) {
+        struct tpool_level *l = &thrd_pool->levels[i];
+        bool ok;
+        switch (thrd_pool->queue) {
+        case TPOOL_QUEUE_LIST:
+            ok = lfqueue_init(&l->list, &thrd_pool->list_nodes);
+            break;
+        case TPOOL_QUEUE_MUTEX:
+            ok = lockqueue_init(&l->locked, capacity, LOCKQUEUE_MUTEX);
+            break;
+        case TPOOL_QUEUE_SPIN:
+            ok = lockqueue_init(&l->locked, capacity, LOCKQUEUE_SPIN);
+            break;
+        default:
+            ok = ring_init(&l->ring, capacity);
+        }
+        if (!ok) {
+            queue_destroy_levels(thrd_pool, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void queue_destroy(tpool_t *thrd_pool)
+{
+    queue_destroy_levels(thrd_pool,
+                         thrd_pool->topology.nnodes * thrd_pool->nlevels);
+}
+
+int tpool_current_node(tpool_t *thrd_pool)
+{
+    struct tpool_worker *self = current_worker;
+    if (self && self->pool == thrd_pool)
+        return self->node;
+    if (thrd_pool->topology.nnodes == 1)
+        return 0;
+    return topology_current_node(&thrd_pool->topology);
+}
+
+/* Free what the queue and the deques retired, once enough of it piled up,
+ * or whenever the worker is about to sleep: between jobs, never inside one
+ * of the operations that retire.
+ */
+static void tpool_reclaim(tpool_t *thrd_pool, bool idle)
+{
+    if (thrd_pool->queue == TPOOL_QUEUE_LIST) {
+        int n = thrd_pool->topology.nnodes * thrd_pool->nlevels;
+        for (int i = 0; i < n; i++)
+            lfqueue_reclaim(&thrd_pool->levels[i].list);
+    }
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL &&
+        (idle || ebr_due(&thrd_pool->ebr)))
+        ebr_reclaim(&thrd_pool->ebr);
+    /* configurations are replaced rarely: no hurry */
+    if (idle)
+        qsbr_reclaim(&thrd_pool->qsbr);
+}
+
+static bool work_available(tpool_t *thrd_pool)
+{
+    int state = atomic_load_explicit(&thrd_pool->state, mo_relaxed);
+    if (state != running)
+        return state == cancelled;
+    if (!queue_empty(thrd_pool))
+        return true;
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL) {
+        int started = atomic_load_explicit(&thrd_pool->started, mo_relaxed);
+        for (int i = 0; i < started; i++) {
+            if (!deque_empty(&thrd_pool->workers[i].deque))
+                return true;
+        }
+    }
+    return false;
+}
+
+/* worker has found nothing to do: poll for a while, then sleep until a job
+ * is added or the employer changes the state, or for timeout_ns if nonzero
+ */
+static void worker_wait(struct tpool_worker *self, int *spins,
+                        uint64_t timeout_ns)
+{
+    tpool_t *thrd_pool = self->pool;
+#ifdef TPOOL_STATS
+    uint64_t start = stats_now();
+#endif
+    if (thrd_pool->wait == TPOOL_WAIT_SPIN) {
+        thrd_yield();
+        stats_count(yields);
+#ifdef TPOOL_STATS
+        stats_add(stats_self, idle_ns, stats_now() - start);
+#endif
+        return;
+    }
+    if ((*spins)++ < TPOOL_SPIN_LIMIT) {
+        spin_pause();
+        stats_count(spins);
+        return;
+    }
+    /* about to sleep: a good time to free what was retired */
+    tpool_reclaim(thrd_pool, true);
+    /* Read the signal, count ourselves in, and only then look for work once
+     * more. Whoever adds work does it in the opposite order, so either we see
+     * the work here, or they see us parked and bump the signal, which makes
+     * park_wait return straight away if we have not gone to sleep yet.
+     */
+    int signal = atomic_load_explicit(&thrd_pool->signal, mo_acquire);
+    atomic_fetch_add_explicit(&thrd_pool->parked, 1, mo_relaxed);
+    atomic_thread_fence(mo_seq_cst);
+    if (!work_available(thrd_pool) &&
+        !(self->fibers && fiber_any_ready(self->fibers))) {
+        /* asleep, it holds up no writer of the configuration */
+        int index = (int)(self - thrd_pool->workers);
+        qsbr_offline(&thrd_pool->qsbr, index);
+        if (timeout_ns)
+            park_wait_for(&thrd_pool->signal, signal, timeout_ns);
+        else
+            park_wait(&thrd_pool->signal, signal);
+        qsbr_online(&thrd_pool->qsbr, index);
+        stats_count(parks);
+#ifdef TPOOL_STATS
+        stats_add(stats_self, idle_ns, stats_now() - start);
+#endif
+    }
+    atomic_fetch_sub_explicit(&thrd_pool->parked, 1, mo_relaxed);
+}
+
+/* Queue a job that was added with tpool_when_all and has just become ready.
+ * It is counted in "pending" already and must not fail: with nowhere to go,
+ * because the ring is full and the pool paused, it runs right here.
+ */
+static void job_ready(struct tpool_future *job)
+{
+    tpool_t *thrd_pool = job->pool;
+#ifdef TPOOL_STATS
+    job->added = stats_now();
+#endif
+    struct tpool_worker *self = current_worker;
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL && self &&
+        self->pool == thrd_pool && deque_push(&self->deque, job)) {
+        tpool_wake(thrd_pool, 1);
+        return;
+    }
+    int node = tpool_current_node(thrd_pool), bulk = thrd_pool->nlevels - 1;
+    while (!queue_push(thrd_pool, node, bulk, job)) {
+        struct tpool_future *oldest = NULL;
+        if (atomic_load_explicit(&thrd_pool->state, mo_relaxed) != running ||
+            !(oldest = level_pop(thrd_pool, node, bulk))) {
+            run_job(thrd_pool, job);
+            return;
+        }
+        run_job(thrd_pool, oldest);
+    }
+    tpool_wake(thrd_pool, 1);
+}
+
+/* One of the futures the dependent job waits on is done. */
+static void dependency_done(struct tpool_future *dependent)
+{
+    /* acq_rel: whoever queues the job has seen what every future it waited
+     * on did, and passes that on to the worker running it
+     */
+    if (atomic_fetch_sub_explicit(&dependent->waiting, 1, mo_acq_rel) == 1)
+        job_ready(dependent);
+}
+
+/* The fiber of a job that stopped in tpool_future_wait can go on: wake its
+ * worker if it is asleep. There is no waking that one alone, so it is all
+ * the parked ones, which are few when jobs wait on each other.
+ */
+static void fiber_resumable(tpool_t *thrd_pool, struct fiber *f)
+{
+    fiber_ready(f);
+    /* the other half of the order worker_wait reads things in */
+    atomic_thread_fence(mo_seq_cst);
+    if (atomic_load_explicit(&thrd_pool->parked, mo_relaxed)) {
+        atomic_fetch_add_explicit(&thrd_pool->signal, 1, mo_release);
+        park_wake(&thrd_pool->signal, INT_MAX);
+    }
+}
+
+/* Marks the links of a future as told: nothing can be added any more. */
+static struct tpool_link links_closed;
+#define LINKS_CLOSED (&links_closed)
+
+/* Have future tell link when it is done, unless it is done already. */
+static bool link_add(struct tpool_future *future, struct tpool_link *link)
+{
+    /* acquire: if it is done, so that the job added sees its result */
+    struct tpool_link *head =
+        atomic_load_explicit(&future->links, mo_acquire);
+    do {
+        if (head == LINKS_CLOSED)
+            return false;
+        link->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &future->links, &head, link, mo_release, mo_acquire));
+    return true;
+}
+
+static void tpool_future_complete(struct tpool_future *future)
+{
+    /* The waiter may see "done", return and free the future before the wakes
+     * below run. That is harmless: a futex wake only hashes the address, and
+     * anyone it disturbs at a reused address re-checks and sleeps again. The
+     * same goes for the batch, so read what is needed of either first.
+     *
+     * acq_rel: a job added after this sees the result, and links added
+     * before it are seen whole here.
+     */
+    tpool_t *thrd_pool = future->pool;
+    struct tpool_link *link = atomic_exchange_explicit(
+        &future->links, LINKS_CLOSED, mo_acq_rel);
+    if (atomic_exchange_explicit(&future->state, FUTURE_DONE, mo_release) ==
+        FUTURE_SLEEPING)
+        park_wake(&future->state, INT_MAX);
+    while (link) {
+        struct tpool_link *next = link->next;
+        if (link->dependent) {
+            dependency_done(link->dependent);
+            slab_free(&thrd_pool->links, link);
+        } else if (link->fiber) {
+            fiber_resumable(thrd_pool, link->fiber);
+            slab_free(&thrd_pool->links, link);
+        } else {
+            /* Set the bit, and take a fiber stopped on the word off it in
+             * the same step: whoever does hands it back, and nothing else
+             * can let it go on and free the batch meanwhile. Acquire, for
+             * batch->fiber.
+             */
+            atomic_int *done = link->done;
+            struct tpool_batch *batch = link->batch;
+            int bit = link->done_bit;
+            int old = atomic_load_explicit(done, mo_relaxed);
+            while (!atomic_compare_exchange_weak_explicit(
+                done, &old, (old | bit) & ~BATCH_FIBER, mo_acq_rel,
+                mo_relaxed))
+                ;
+            if (old & BATCH_SLEEPING)
+                park_wake(done, INT_MAX);
+            else if (old & BATCH_FIBER)
+                fiber_resumable(thrd_pool, batch->fiber);
+        }
+        link = next;
+    }
+}
+
+static void run_job(tpool_t *thrd_pool, struct tpool_future *job)
+{
+    /* a job may wait on others and so run them in turn: restore ours after */
+    struct tpool_future *outer = current_job;
+#ifdef TPOOL_STATS
+    struct stats_counters *stats = stats_of(thrd_pool);
+    uint64_t start = stats_now();
+    stats_record(stats, stats->queue_wait, start - job->added);
+#endif
+    current_job = job;
+    job->result = job->func(job->arg);
+    current_job = outer;
+#ifdef TPOOL_STATS
+    stats_record(stats, stats->run_time, stats_now() - start);
+    stats_add(stats, jobs, 1);
+#endif
+    /* the future belongs to its waiter from here on: do not touch it */
+    tpool_future_complete(job);
+    /* release: tpool_wait_idle returning means the job's effects are seen */
+    counter_sub(&thrd_pool->pending, pending_slot(thrd_pool), 1);
+}
+
+/* xorshift: cheap, and good enough to spread thieves over their victims */
+static unsigned int next_random(unsigned int *seed)
+{
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+/* Start at a random victim, so that thieves do not all line up behind the
+ * first busy worker. Victims on the own node go first: what they spawned is
+ * in memory close by.
+ */
+static struct tpool_future *worker_steal(struct tpool_worker *self)
+{
+    tpool_t *thrd_pool = self->pool;
+    int started = atomic_load_explicit(&thrd_pool->started, mo_relaxed);
+    int start = next_random(&self->seed) % started;
+    struct tpool_future *job = NULL;
+    /* a victim's deque may grow under us: keep its old array alive */
+    struct ebr_record *rec = ebr_enter(&thrd_pool->ebr);
+    for (int remote = 0; remote < 2 && !job; remote++) {
+        for (int i = 0; i < started && !job; i++) {
+            struct tpool_worker *victim =
+                &thrd_pool->workers[(start + i) % started];
+            if (victim != self && (victim->node != self->node) == remote)
+                job = deque_steal(&victim->deque);
+        }
+    }
+    ebr_exit(&thrd_pool->ebr, rec);
+    if (job)
+        stats_count(steals);
+    return job;
+}
+
+/* Urgent jobs before anything else. Then the own deque, since that is what
+ * this worker spawned most recently and still has in cache, then the bulk of
+ * the shared queue, and only then someone else's deque. Each shared level is
+ * tried on the own node before the others.
+ */
+static struct tpool_future *find_job(struct tpool_worker *self)
+{
+    tpool_t *thrd_pool = self->pool;
+    struct tpool_future *job;
+    int bulk = thrd_pool->nlevels - 1;
+    for (int i = 0; i < bulk; i++) {
+        if ((job = level_pop_near(thrd_pool, self->node, i)))
+            return job;
+    }
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL &&
+        (job = deque_take(&self->deque)))
+        return job;
+    if ((job = level_pop_near(thrd_pool, self->node, bulk)))
+        return job;
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL)
+        return worker_steal(self);
+    return NULL;
+}
+
+/* Stop the job running on the current fiber, and have the worker go on with
+ * next until whoever the fiber was left with hands it back.
+ */
+static void worker_switch(struct tpool_worker *self, struct fiber *next)
+{
+    /* Whoever that is may hand the fiber back at once, but only this thread
+     * runs it, and not before it has left it here.
+     */
+    struct tpool_future *job = current_job;
+    current_job = NULL;
+    self->suspended++;
+    fiber_switch(self->fibers, next);
+    self->suspended--;
+    current_job = job;
+}
+
+/* Whether the calling thread runs a job on a fiber that can be stopped, and
+ * whose worker belongs to thrd_pool.
+ */
+static bool worker_can_stop(struct tpool_worker *self, tpool_t *thrd_pool)
+{
+    return self && self->fibers && self->fibers->current && current_job &&
+           self->pool == thrd_pool;
+}
+
+/* A worker waiting on a job lends a hand until it is done: run one job of
+ * its pool, if there is one.
+ */
+static bool worker_help(void)
+{
+    struct tpool_worker *self = current_worker;
+    if (!self ||
+        atomic_load_explicit(&self->pool->state, mo_relaxed) != running)
+        return false;
+    struct tpool_future *job = find_job(self);
+    if (!job)
+        return false;
+    run_job(self->pool, job);
+    return true;
+}
+
+/* Under "fibers", stop the job waiting on future, one of its own pool, until
+ * the future is done, and have its worker go round the loop on another fiber
+ * meanwhile. Does nothing where there is no stopping it: outside such a job,
+ * or out of memory.
+ */
+static void worker_suspend(struct tpool_future *future)
+{
+    struct tpool_worker *self = current_worker;
+    if (!worker_can_stop(self, future->pool))
+        return;
+    tpool_t *thrd_pool = self->pool;
+    struct fiber_set *set = self->fibers;
+    struct tpool_link *link = slab_alloc(&thrd_pool->links);
+    if (!link)
+        return;
+    /* the fiber to go on with, before there is no turning back */
+    struct fiber *next = fiber_get(set);
+    if (!next) {
+        slab_free(&thrd_pool->links, link);
+        return;
+    }
+    link->dependent = NULL;
+    link->fiber = set->current;
+    if (!link_add(future, link)) {
+        /* done already */
+        fiber_put(set, next);
+        slab_free(&thrd_pool->links, link);
+        return;
+    }
+    worker_switch(self, next);
+}
+
+/* worker_suspend for a word of a batch, seen to hold v: stop until one more
+ * of its jobs is done. Returns false where there is no stopping, as
+ * worker_suspend does nothing there; otherwise the word is worth another
+ * look. Helping in place instead would leave a job that stopped in a wait on
+ * this worker, and is handed back meanwhile, stuck until the whole batch is
+ * done, which may need that very job.
+ */
+static bool worker_suspend_batch(struct tpool_batch *batch, atomic_int *done,
+                                 int v)
+{
+    struct tpool_worker *self = current_worker;
+    if ((v & BATCH_SLEEPING) || !worker_can_stop(self, batch->pool))
+        return false;
+    struct fiber_set *set = self->fibers;
+    struct fiber *next = fiber_get(set);
+    if (!next)
+        return false;
+    /* release: the job that hands the fiber back reads it */
+    batch->fiber = set->current;
+    if (!atomic_compare_exchange_strong_explicit(
+            done, &v, v | BATCH_FIBER, mo_release, mo_relaxed)) {
+        /* a job finished meanwhile */
+        fiber_put(set, next);
+        return true;
+    }
+    worker_switch(self, next);
+    return true;
+}
+
+void tpool_future_wait(struct tpool_future *future)
+{
+    if (atomic_load_explicit(&future->state, mo_acquire) != FUTURE_DONE)
+        worker_suspend(future);
+    for (int spins = 0;
+         atomic_load_explicit(&future->state, mo_acquire) != FUTURE_DONE;
+         spins++) {
+        if (worker_help()) {
+            spins = 0;
+            continue;
+        }
+        if (future->pool->wait == TPOOL_WAIT_SPIN)
+            continue;
+        if (spins < TPOOL_SPIN_LIMIT) {
+            spin_pause();
+            continue;
+        }
+        int expected = FUTURE_PENDING;
+        if (atomic_compare_exchange_strong_explicit(&future->state, &expected,
+                                                    FUTURE_SLEEPING, mo_relaxed,
+                                                    mo_relaxed) ||
+            expected == FUTURE_SLEEPING)
+            park_wait(&future->state, FUTURE_SLEEPING);
+    }
+}
+
+/* how long a worker above min_threads idles before it retires */
+static uint64_t idle_ns(tpool_t *thrd_pool)
+{
+    int ms = thrd_pool->idle_ms > 0 ? thrd_pool->idle_ms : TPOOL_IDLE_MS;
+    return (uint64_t)ms * 1000000;
+}
+
+/* Whether self, idle since *idle_since or from now on, retires now: only the
+ * last active worker does, once idle for idle_ms or at once if it is over the
+ * target, and never one of the first min_threads, nor one with jobs stopped
+ * in a wait, which only it can go on with.
+ */
+static bool worker_retire(struct tpool_worker *self, uint64_t *idle_since)
+{
+    tpool_t *thrd_pool = self->pool;
+    int index = (int)(self - thrd_pool->workers);
+    if (index < thrd_pool->min || self->suspended)
+        return false;
+    uint64_t now = clock_ns();
+    if (!*idle_since)
+        *idle_since = now;
+    int active = atomic_load_explicit(&thrd_pool->active, mo_relaxed);
+    if (index != active - 1)
+        return false;
+    const struct tpool_config *config = tpool_config(thrd_pool);
+    if (index < config->target && now - *idle_since < config->idle_ns)
+        return false;
+    return atomic_compare_exchange_strong_explicit(
+        &thrd_pool->active, &active, index, mo_relaxed, mo_relaxed);
+}
+
+/* Sleep for as long as self is retired: until the pool grows back over it,
+ * or is destroyed. Read "resize" first, so that a change to either that
+ * comes after the check makes park_wait return. Offline meanwhile, as far as
+ * the configuration goes.
+ */
+static void worker_sleep_retired(struct tpool_worker *self)
+{
+    tpool_t *thrd_pool = self->pool;
+    int index = (int)(self - thrd_pool->workers);
+    qsbr_offline(&thrd_pool->qsbr, index);
+    while (1) {
+        int resize = atomic_load_explicit(&thrd_pool->resize, mo_acquire);
+        if (index < atomic_load_explicit(&thrd_pool->active, mo_relaxed) ||
+            atomic_load_explicit(&thrd_pool->state, mo_relaxed) == cancelled)
+            break;
+        park_wait(&thrd_pool->resize, resize);
+    }
+    qsbr_online(&thrd_pool->qsbr, index);
+}
+
+/* Round and round until the pool is destroyed. Under "fibers" this is what
+ * every fiber of the worker runs: one goes round until its job stops in a
+ * wait, the next takes over, and the one that sees the pool destroyed
+ * returns.
+ */
+static void worker_loop(struct tpool_worker *self)
+{
+    tpool_t *thrd_pool = self->pool;
+    int index = (int)(self - thrd_pool->workers);
+    bool elastic = thrd_pool->min < thrd_pool->size;
+    int spins = 0;
+    uint64_t idle_since = 0;
+    /* the ones that may retire wake up now and then to see if it is time */
+    uint64_t timeout_ns = index >= thrd_pool->min ? idle_ns(thrd_pool) : 0;
+
+    while (1) {
+        /* between jobs: no pointer into the configuration held */
+        qsbr_quiescent(&thrd_pool->qsbr, index);
+        int state = atomic_load_explicit(&thrd_pool->state, mo_relaxed);
+        /* worker is laid off */
+        if (state == cancelled) {
+            qsbr_offline(&thrd_pool->qsbr, index);
+            return;
+        }
+        /* A job that stopped in a wait and can go on comes first: it has
+         * started already. This fiber is free to go round again afterwards.
+         */
+        struct fiber *ready =
+            self->fibers ? fiber_take_ready(self->fibers) : NULL;
+        if (ready) {
+            fiber_yield(self->fibers, ready);
+            spins = 0;
+            idle_since = 0;
+            continue;
+        }
+        /* worker takes the job */
+        struct tpool_future *job = state == running ? find_job(self) : NULL;
+        if (job) {
+            /* and if there is more than the rest can take, hires help */
+            if (elastic)
+                tpool_grow(thrd_pool);
+            run_job(thrd_pool, job);
+            tpool_reclaim(thrd_pool, false);
+            spins = 0;
+            idle_since = 0;
+        } else if (state == running && elastic &&
+                   worker_retire(self, &idle_since)) {
+            /* Worker is let go, until there is work again. The one before it
+             * is the last now, and with no way to wake that one alone, wake
+             * the idle ones so that it sees whether it has idled long enough.
+             */
+            atomic_fetch_add_explicit(&thrd_pool->signal, 1, mo_release);
+            park_wake(&thrd_pool->signal, INT_MAX);
+            tpool_reclaim(thrd_pool, true);
+            worker_sleep_retired(self);
+            spins = 0;
+            idle_since = 0;
+        } else {
+            /* worker is idle */
+            worker_wait(self, &spins, timeout_ns);
+        }
+    }
+}
+
+static void worker_fiber(void)
+{
+    struct tpool_worker *self = current_worker;
+    worker_loop(self);
+    fiber_exit(self->fibers);
+}
+
+/* Go round on fibers until the pool is destroyed. They stay until
+ * tpool_destroy, since workers still finishing a job may hand one back.
+ * Returns false, having done nothing, if out of memory.
+ */
+static bool worker_loop_fibers(struct tpool_worker *self)
+{
+    struct fiber_set *set = malloc(sizeof(*set));
+    if (!set)
+        return false;
+    fiber_set_init(set, worker_fiber, self->pool->fiber_stack);
+    struct fiber *first = fiber_get(set);
+    if (!first) {
+        free(set);
+        return false;
+    }
+    self->fibers = set;
+    /* back here once one of them has seen the pool destroyed */
+    fiber_switch(set, first);
+    return true;
+}
+
+static int worker(void *args)
+{
+    if (!args)
+        return EXIT_FAILURE;
+    struct tpool_worker *self = (struct tpool_worker *)args;
+    tpool_t *thrd_pool = self->pool;
+
+    current_worker = self;
+#ifdef TPOOL_STATS
+    stats_self = &self->stats;
+#endif
+    /* Pinned first thing, so that whatever the worker allocates from here on
+     * comes from its node's memory.
+     */
+    if (thrd_pool->pin)
+        topology_pin(self->cpu);
+    /* a worker the pool grew by starts out retired, until it is taken in */
+    worker_sleep_retired(self);
+    /* without the memory for fibers, jobs wait the way they do without */
+    if (!thrd_pool->fibers || !worker_loop_fibers(self))
+        worker_loop(self);
+    return EXIT_SUCCESS;
+}
+
+/* Free the workers, and the deques and fibers of the first "size". */
+static void tpool_free_workers(tpool_t *thrd_pool, size_t size)
+{
+    /* whatever jobs are still stopped in a wait never go on */
+    for (size_t i = 0; i < size; i++) {
+        struct fiber_set *set = thrd_pool->workers[i].fibers;
+        if (set) {
+            fiber_set_destroy(set);
+            free(set);
+        }
+    }
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL) {
+        for (size_t i = 0; i < size; i++)
+            deque_destroy(&thrd_pool->workers[i].deque);
+    }
+    free(thrd_pool->workers);
+    thrd_pool->workers = NULL;
+}
+
+bool tpool_init(tpool_t *thrd_pool, size_t size)
+{
+    if (atomic_flag_test_and_set(&thrd_pool->initialized)) {
+        printf("This thread pool has already been initialized.\n");
+        return false;
+    }
+
+    assert(size > 0);
+    size_t ready = 0; /* workers whose deques are set up */
+    thrd_pool->pool = malloc(sizeof(thrd_t) * size);
+    if (!thrd_pool->pool) {
+        printf("Failed to allocate thread identifiers.\n");
+        goto fail;
+    }
+
+    if (!queue_init(thrd_pool)) {
+        printf("Failed to allocate the job queue.\n");
+        goto undo_pool;
+    }
+
+    if (!slab_init(&thrd_pool->futures, sizeof(struct tpool_future),
+                   _Alignof(struct tpool_future))) {
+        printf("Failed to set up the future allocator.\n");
+        goto undo_queue;
+    }
+    if (!slab_init(&thrd_pool->links, sizeof(struct tpool_link),
+                   _Alignof(struct tpool_link))) {
+        printf("Failed to set up the link allocator.\n");
+        goto undo_futures;
+    }
+
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL && !ebr_init(&thrd_pool->ebr)) {
+        printf("Failed to allocate workers.\n");
+        goto undo_links;
+    }
+    /* aligned_alloc, not malloc: each worker's deque indices sit on lines of
+     * their own only if the array starts on a cache line boundary.
+     */
+    thrd_pool->workers = aligned_alloc(_Alignof(struct tpool_worker),
+                                       sizeof(struct tpool_worker) * size);
+    if (!thrd_pool->workers) {
+        printf("Failed to allocate workers.\n");
+        goto undo_ebr;
+    }
+    const struct topology *topo = &thrd_pool->topology;
+    for (; ready < size; ready++) {
+        size_t i = ready;
+        struct tpool_worker *w = &thrd_pool->workers[i];
+        w->pool = thrd_pool;
+        w->seed = 2654435761u * (i + 1); /* any nonzero seed will do */
+        /* workers spread evenly over the nodes, and over each node's CPUs */
+        w->node = (int)(i * topo->nnodes / size);
+        size_t first = (w->node * size + topo->nnodes - 1) / topo->nnodes;
+        int ncpus = topo->first[w->node + 1] - topo->first[w->node];
+        w->cpu = topo->cpus[topo->first[w->node] + (i - first) % ncpus];
+        w->fibers = NULL;
+        w->suspended = 0;
+#ifdef TPOOL_STATS
+        stats_init(&w->stats, false);
+#endif
+        if (thrd_pool->sched == TPOOL_SCHED_STEAL &&
+            !deque_init(&w->deque, TPOOL_DEQUE_SIZE, &thrd_pool->ebr)) {
+            printf("Failed to allocate the deque of worker %zu.\n", i);
+            goto undo_workers;
+        }
+    }
+
+    if (!counter_init(&thrd_pool->pending, (int)size)) {
+        printf("Failed to allocate the job counter.\n");
+        goto undo_workers;
+    }
+    if (!qsbr_init(&thrd_pool->qsbr, (int)size)) {
+        printf("Failed to set up the configuration readers.\n");
+        goto undo_counter;
+    }
+
+    thrd_pool->func = worker;
+#ifdef TPOOL_STATS
+    stats_init(&thrd_pool->outside, true);
+#endif
+    atomic_init(&thrd_pool->state, idle);
+    atomic_init(&thrd_pool->signal, 0);
+    atomic_init(&thrd_pool->parked, 0);
+    thrd_pool->size = size;
+    thrd_pool->min = thrd_pool->min_threads > 0 &&
+                             (size_t)thrd_pool->min_threads < size
+                         ? thrd_pool->min_threads
+                         : (int)size;
+    atomic_init(&thrd_pool->started, thrd_pool->min);
+    atomic_init(&thrd_pool->active, thrd_pool->min);
+    thrd_pool->initial.target = (int)size;
+    thrd_pool->initial.idle_ns = idle_ns(thrd_pool);
+    atomic_init(&thrd_pool->config, &thrd_pool->initial);
+    atomic_init(&thrd_pool->resize, 0);
+    if (mtx_init(&thrd_pool->grow_lock, mtx_plain) != thrd_success) {
+        printf("Failed to set up the worker lock.\n");
+        goto undo_qsbr;
+    }
+
+    /* employer hires the first workers, and the rest as the work calls for */
+    for (int i = 0; i < thrd_pool->min; i++) {
+        if (thrd_create(thrd_pool->pool + i, worker,
+                        &thrd_pool->workers[i]) != thrd_success) {
+            printf("Failed to create worker %d.\n", i);
+            atomic_store(&thrd_pool->state, cancelled);
+            tpool_wake(thrd_pool, INT_MAX);
+            while (i--)
+                thrd_join(thrd_pool->pool[i], NULL);
+            goto undo_grow_lock;
+        }
+    }
+
+    return true;
+
+    /* Undo what was set up, the latest first: each failure above jumps to
+     * the step for what it was setting up last.
+     */
+undo_grow_lock:
+    mtx_destroy(&thrd_pool->grow_lock);
+undo_qsbr:
+    qsbr_destroy(&thrd_pool->qsbr);
+undo_counter:
+    counter_destroy(&thrd_pool->pending);
+undo_workers:
+    tpool_free_workers(thrd_pool, ready);
+undo_ebr:
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL)
+        ebr_destroy(&thrd_pool->ebr);
+undo_links:
+    slab_destroy(&thrd_pool->links);
+undo_futures:
+    slab_destroy(&thrd_pool->futures);
+undo_queue:
+    queue_destroy(thrd_pool);
+undo_pool:
+    free(thrd_pool->pool);
+    thrd_pool->pool = NULL;
+    thrd_pool->size = 0;
+fail:
+    atomic_flag_clear(&thrd_pool->initialized);
+    return false;
+}
+
+void tpool_destroy(tpool_t *thrd_pool)
+{
+    if (atomic_exchange(&thrd_pool->state, cancelled) == running &&
+        counter_read_exact(&thrd_pool->pending))
+        printf("Thread pool cancelled with jobs still running.\n");
+    tpool_wake(thrd_pool, INT_MAX);
+    /* Once the lock is free, no thread is started any more. Then get the
+     * retired ones up to leave as well.
+     */
+    mtx_lock(&thrd_pool->grow_lock);
+    mtx_unlock(&thrd_pool->grow_lock);
+    atomic_fetch_add_explicit(&thrd_pool->resize, 1, mo_release);
+    park_wake(&thrd_pool->resize, INT_MAX);
+
+    int started = atomic_load_explicit(&thrd_pool->started, mo_relaxed);
+    for (int i = 0; i < started; i++)
+        thrd_join(thrd_pool->pool[i], NULL);
+    mtx_destroy(&thrd_pool->grow_lock);
+
+    /* Workers are all joined, so the queue is ours alone now. Unclaimed jobs
+     * own a future that nobody will ever wait on; free them.
+     */
+    struct tpool_future *job;
+    while ((job = queue_pop(thrd_pool)))
+        tpool_future_destroy(job);
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL) {
+        for (int i = 0; i < thrd_pool->size; i++) {
+            while ((job = deque_take(&thrd_pool->workers[i].deque)))
+                tpool_future_destroy(job);
+        }
+    }
+    tpool_free_workers(thrd_pool, thrd_pool->size);
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL)
+        ebr_destroy(&thrd_pool->ebr);
+    struct tpool_config *config =
+        atomic_load_explicit(&thrd_pool->config, mo_relaxed);
+    if (config != &thrd_pool->initial)
+        free(config);
+    qsbr_destroy(&thrd_pool->qsbr);
+    counter_destroy(&thrd_pool->pending);
+    slab_destroy(&thrd_pool->futures);
+    slab_destroy(&thrd_pool->links);
+    queue_destroy(thrd_pool);
+    free(thrd_pool->pool);
+    atomic_store(&thrd_pool->state, idle);
+    atomic_flag_clear(&thrd_pool->initialized);
+}
+
+/* Queue a future just created at the given priority, as add_job does, or
+ * free it and return NULL where add_job fails.
+ */
+static struct tpool_future *future_submit(tpool_t *thrd_pool, int priority,
+                                          struct tpool_future *future)
+{
+    /* out of range is taken as the nearest level, not trusted */
+    int level = priority < 0                        ? 0
+                : priority < thrd_pool->nlevels - 1 ? priority
+                                                    : thrd_pool->nlevels - 1;
+    int slot = pending_slot(thrd_pool);
+    counter_add(&thrd_pool->pending, slot, 1);
+    int node = tpool_current_node(thrd_pool);
+    struct tpool_worker *self = current_worker;
+    if (level == thrd_pool->nlevels - 1 &&
+        thrd_pool->sched == TPOOL_SCHED_STEAL && self &&
+        self->pool == thrd_pool && deque_push(&self->deque, future)) {
+        /* let a parked worker know there is something to steal */
+        tpool_wake(thrd_pool, 1);
+        return future;
+    }
+    while (!queue_push(thrd_pool, node, level, future)) {
+        if (atomic_load_explicit(&thrd_pool->state, mo_relaxed) != running) {
+            counter_sub(&thrd_pool->pending, slot, 1);
+            slab_free(&thrd_pool->futures, future);
+            return NULL;
+        }
+        /* The queue is full: make room by doing the oldest job ourselves,
+         * which also holds back a producer that outruns the workers.
+         */
+        struct tpool_future *job = level_pop(thrd_pool, node, level);
+        if (job)
+            run_job(thrd_pool, job);
+    }
+    tpool_wake(thrd_pool, 1);
+    return future;
+}
+
+struct tpool_future *tpool_add_priority(tpool_t *thrd_pool, int priority,
+                                        void *(*func)(void *), void *arg)
+{
+    struct tpool_future *future = future_create(thrd_pool, func, arg);
+    if (!future)
+        return NULL;
+    return future_submit(thrd_pool, priority, future);
+}
+
+struct tpool_future *tpool_add_inline(tpool_t *thrd_pool,
+                                      void *(*func)(void *), const void *arg,
+                                      size_t size)
+{
+    struct tpool_future *future = future_create(thrd_pool, func, NULL);
+    if (!future)
+        return NULL;
+    assert(size <= sizeof(future->inline_result));
+    memcpy(future->inline_result, arg, size);
+    future->arg = future->inline_result;
+    return future_submit(thrd_pool, INT_MAX, future);
+}
+
+struct tpool_future *add_job(tpool_t *thrd_pool, void *(*func)(void *),
+                             void *arg)
+{
+    return tpool_add_priority(thrd_pool, INT_MAX, func, arg);
+}
+
+static void *future_at(void *futures, size_t i)
+{
+    return ((struct tpool_future **)futures)[i];
+}
+
+/* add_jobs, reporting to batch if there is one */
+static size_t add_jobs_to(tpool_t *thrd_pool, void *(*func)(void *),
+                          void **args, size_t n,
+                          struct tpool_future **futures,
+                          struct tpool_batch *batch)
+{
+    for (size_t i = 0; i < n; i++) {
+        futures[i] = future_create(thrd_pool, func, args[i]);
+        if (!futures[i]) {
+            while (i--)
+                slab_free(&thrd_pool->futures, futures[i]);
+            for (i = 0; i < n; i++)
+                futures[i] = NULL;
+            return 0;
+        }
+        if (batch) {
+            size_t bit = batch->size + i;
+            struct tpool_link *link = &batch->links[bit];
+            link->next = NULL;
+            link->dependent = NULL;
+            link->fiber = NULL;
+            link->batch = batch;
+            link->done = &batch->done[bit / TPOOL_BATCH_BITS];
+            link->done_bit = 1 << bit % TPOOL_BATCH_BITS;
+            atomic_init(&futures[i]->links, link);
+        }
+    }
+
+    int slot = pending_slot(thrd_pool);
+    counter_add(&thrd_pool->pending, slot, n);
+    size_t added = 0;
+    int node = tpool_current_node(thrd_pool), bulk = thrd_pool->nlevels - 1;
+    struct tpool_worker *self = current_worker;
+    if (thrd_pool->sched == TPOOL_SCHED_STEAL && self &&
+        self->pool == thrd_pool) {
+        /* the deque is ours alone: pushing costs no read-modify-write */
+        while (added < n && deque_push(&self->deque, futures[added]))
+            added++;
+        if (added)
+            tpool_wake(thrd_pool, added < INT_MAX ? (int)added : INT_MAX);
+    }
+    while (added < n) {
+        size_t k = queue_push_n(thrd_pool, node, bulk, future_at,
+                                futures + added, n - added);
+        if (k) {
+            added += k;
+            tpool_wake(thrd_pool, k < INT_MAX ? (int)k : INT_MAX);
+            continue;
+        }
+        /* full: make room as add_job does, or give up on a paused pool */
+        if (atomic_load_explicit(&thrd_pool->state, mo_relaxed) != running)
+            break;
+        struct tpool_future *job = level_pop(thrd_pool, node, bulk);
+        if (job)
+            run_job(thrd_pool, job);
+    }
+
+    if (added < n) {
+        counter_sub(&thrd_pool->pending, slot, n - added);
+        for (size_t i = added; i < n; i++) {
+            slab_free(&thrd_pool->futures, futures[i]);
+            futures[i] = NULL;
+        }
+    }
+    return added;
+}
+
+size_t add_jobs(tpool_t *thrd_pool, void *(*func)(void *), void **args,
+                size_t n, struct tpool_future **futures)
+{
+    return add_jobs_to(thrd_pool, func, args, n, futures, NULL);
+}
+
+struct tpool_future *tpool_when_all(tpool_t *thrd_pool,
+                                    struct tpool_future **futures, size_t n,
+                                    void *(*func)(void *), void *arg)
+{
+    assert(n < INT_MAX);
+    struct tpool_future *job = future_create(thrd_pool, func, arg);
+    if (!job)
+        return NULL;
+    /* every link first, so that running out of memory leaves nothing to undo
+     * in futures that may already be completing
+     */
+    struct tpool_link *links = NULL;
+    for (size_t i = 0; i < n; i++) {
+        struct tpool_link *link = slab_alloc(&thrd_pool->links);
+        if (!link) {
+            while (links) {
+                struct tpool_link *next = links->next;
+                slab_free(&thrd_pool->links, links);
+                links = next;
+            }
+            slab_free(&thrd_pool->futures, job);
+            return NULL;
+        }
+        link->next = links;
+        link->dependent = job;
+        link->fiber = NULL;
+        links = link;
+    }
+
+    /* One more than there are futures, which the loop below holds on to: the
+     * job cannot become ready, and run, before every link is in place.
+     */
+    atomic_init(&job->waiting, (int)n + 1);
+    counter_add(&thrd_pool->pending, pending_slot(thrd_pool), 1);
+    for (size_t i = 0; i < n; i++) {
+        struct tpool_link *link = links;
+        links = link->next;
+        assert(futures[i]->pool == thrd_pool);
+        if (!link_add(futures[i], link)) {
+            slab_free(&thrd_pool->links, link);
+            atomic_fetch_sub_explicit(&job->waiting, 1, mo_relaxed);
+        }
+    }
+    dependency_done(job);
+    return job;
+}
+
+struct tpool_future *tpool_then(struct tpool_future *future,
+                                void *(*func)(void *), void *arg)
+{
+    return tpool_when_all(future->pool, &future, 1, func, arg);
+}
+
+struct tpool_batch *tpool_batch_create(size_t capacity)
+{
+    size_t words = (capacity + TPOOL_BATCH_BITS - 1) / TPOOL_BATCH_BITS;
+    /* the links go after the bits, aligned as they need */
+    size_t align = _Alignof(struct tpool_link);
+    size_t links = (sizeof(struct tpool_batch) + sizeof(atomic_int) * words +
+                    align - 1) / align * align;
+    struct tpool_batch *batch =
+        malloc(links + sizeof(struct tpool_link) * capacity);
+    if (!batch)
+        return NULL;
+    batch->pool = NULL;
+    batch->size = 0;
+    batch->capacity = capacity;
+    batch->fiber = NULL;
+    batch->links = (struct tpool_link *)((char *)batch + links);
+    for (size_t i = 0; i < words; i++)
+        atomic_init(&batch->done[i], 0);
+    return batch;
+}
+
+void tpool_batch_destroy(struct tpool_batch *batch)
+{
+    free(batch);
+}
+
+size_t tpool_batch_add(tpool_t *thrd_pool, struct tpool_batch *batch,
+                       void *(*func)(void *), void **args, size_t n,
+                       struct tpool_future **futures)
+{
+    assert(!batch->pool || batch->pool == thrd_pool);
+    batch->pool = thrd_pool;
+    size_t room = batch->capacity - batch->size, added;
+    for (size_t i = room; i < n; i++)
+        futures[i] = NULL;
+    added = add_jobs_to(thrd_pool, func, args, n < room ? n : room, futures,
+                        batch);
+    batch->size += added;
+    return added;
+}
+
+void tpool_batch_wait(struct tpool_batch *batch)
+{
+    for (size_t w = 0; w * TPOOL_BATCH_BITS < batch->size; w++) {
+        size_t left = batch->size - w * TPOOL_BATCH_BITS;
+        int all = (1 << (left < TPOOL_BATCH_BITS ? left : TPOOL_BATCH_BITS)) -
+                  1;
+        atomic_int *done = &batch->done[w];
+        int v;
+        for (int spins = 0;
+             ((v = atomic_load_explicit(done, mo_acquire)) & all) != all;
+             spins++) {
+            if (worker_suspend_batch(batch, done, v))
+                continue;
+            if (worker_help()) {
+                spins = 0;
+                continue;
+            }
+            if (batch->pool->wait == TPOOL_WAIT_SPIN)
+                continue;
+            if (spins < TPOOL_SPIN_LIMIT) {
+                spin_pause();
+                continue;
+            }
+            /* as for a future: say we sleep, then sleep unless it changed */
+            if ((v & BATCH_SLEEPING) ||
+                atomic_compare_exchange_strong_explicit(
+                    done, &v, v | BATCH_SLEEPING, mo_relaxed, mo_relaxed))
+                park_wait(done, v | BATCH_SLEEPING);
+        }
+    }
+}
+
+void tpool_run(tpool_t *thrd_pool)
+{
+    atomic_store(&thrd_pool->state, running);
+    tpool_wake(thrd_pool, INT_MAX);
+}
+
+bool tpool_set_target(tpool_t *thrd_pool, int n)
+{
+    if (n < thrd_pool->min)
+        n = thrd_pool->min;
+    if (n > thrd_pool->size)
+        n = thrd_pool->size;
+    struct tpool_config *config = malloc(sizeof(*config));
+    if (!config)
+        return false;
+    /* Copy, change and swap under grow_lock, so that the threads reading
+     * under it see either copy whole; the workers read without it.
+     */
+    mtx_lock(&thrd_pool->grow_lock);
+    struct tpool_config *old = tpool_config(thrd_pool);
+    *config = *old;
+    config->target = n;
+    qsbr_publish(&thrd_pool->config, config);
+    mtx_unlock(&thrd_pool->grow_lock);
+    if (old != &thrd_pool->initial)
+        qsbr_retire(&thrd_pool->qsbr, &old->node, config_free);
+    /* what earlier calls retired may be free to go by now */
+    qsbr_reclaim(&thrd_pool->qsbr);
+
+    if (atomic_load_explicit(&thrd_pool->active, mo_relaxed) > n) {
+        /* idle workers over the target retire as soon as they wake */
+        atomic_fetch_add_explicit(&thrd_pool->signal, 1, mo_release);
+        park_wake(&thrd_pool->signal, INT_MAX);
+    } else {
+        tpool_grow(thrd_pool);
+    }
+    return true;
+}
+
+int tpool_active(tpool_t *thrd_pool)
+{
+    return atomic_load_explicit(&thrd_pool->active, mo_relaxed);
+}
+
+void tpool_wait_idle(tpool_t *thrd_pool)
+{
+    while (counter_read_exact(&thrd_pool->pending))
+        thrd_yield();
+}
+
+#ifdef TPOOL_STATS
+static void stats_sum(struct tpool_stats *stats, struct stats_counters *c)
+{
+    stats->jobs += atomic_load_explicit(&c->jobs, mo_relaxed);
+    stats->steals += atomic_load_explicit(&c->steals, mo_relaxed);
+    stats->pop_retries += atomic_load_explicit(&c->pop_retries, mo_relaxed);
+    stats->spins += atomic_load_explicit(&c->spins, mo_relaxed);
+    stats->yields += atomic_load_explicit(&c->yields, mo_relaxed);
+    stats->parks += atomic_load_explicit(&c->parks, mo_relaxed);
+    stats->idle_ns += atomic_load_explicit(&c->idle_ns, mo_relaxed);
+    for (int i = 0; i < TPOOL_STATS_BUCKETS; i++) {
+        stats->queue_wait[i] +=
+            atomic_load_explicit(&c->queue_wait[i], mo_relaxed);
+        stats->run_time[i] += atomic_load_explicit(&c->run_time[i], mo_relaxed);
+    }
+}
+#endif
+
+bool tpool_stats_snapshot(tpool_t *thrd_pool, struct tpool_stats *stats)
+{
+    *stats = (struct tpool_stats){ 0 };
+#ifdef TPOOL_STATS
+    for (int i = 0; i < thrd_pool->size; i++)
+        stats_sum(stats, &thrd_pool->workers[i].stats);
+    stats_sum(stats, &thrd_pool->outside);
+    return true;
+#else
+    (void)thrd_pool;
+    return false;
+#endif
+}
@@ -0,0 +1,414 @@
+#ifndef TPOOL_H
+#define TPOOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "cacheline.h"
+#include "counter.h"
+#include "deque.h"
+#include "lfqueue.h"
+#include "lockqueue.h"
+#include "qsbr.h"
+#include "ring.h"
+#include "slab.h"
+#include "stats.h"
+#include "topology.h"
+
+/* The thread pool from the "Read-modify-write" example, lifted out of the
+ * book's listing so that it can grow the features a real workload needs
+ * without the listing growing with it. The interface is the one the listing
+ * uses, so its main() reads the same against either.
+ */
+
+/* What a thread with nothing to do does in the meantime. The book's pool
+ * spins, which answers fastest and keeps every core busy doing nothing. The
+ * default spins for a bounded while and then sleeps in the kernel until it is
+ * woken, which costs a system call on the wake-up path but lets an idle pool
+ * drop to no CPU at all.
+ */
+enum tpool_wait { TPOOL_WAIT_PARK, TPOOL_WAIT_SPIN };
+
+/* Where workers find their jobs. By default they all pop from the one queue
+ * add_job fills, which is fair and simple but makes every worker hit the same
+ * cache lines. With TPOOL_SCHED_STEAL each worker also owns a deque: a job
+ * that adds jobs puts them on its own worker's deque, the worker runs them
+ * from there, and a worker that runs dry steals from a random other one. The
+ * shared queue then only carries the jobs added from outside the pool.
+ */
+enum tpool_sched { TPOOL_SCHED_SHARED, TPOOL_SCHED_STEAL };
+
+/* What the shared queue is. The ring is an array of "capacity" slots that
+ * pushes back on add_job when full. TPOOL_QUEUE_LIST is a linked queue with
+ * no fixed size, lock-free with nothing wider than a 64-bit CAS. It costs a
+ * node per job, recycled rather than freed, and a thread stalled mid-push
+ * never holds up the others, which the ring cannot promise.
+ *
+ * Those two are the manuscript's SPMC solution with CAS. TPOOL_QUEUE_MUTEX
+ * and TPOOL_QUEUE_SPIN are its lock-based solutions, as arrays of "capacity"
+ * behind a mutex and behind a spinlock; see lockqueue.h. Lock-free is not
+ * always faster, so the choice is left to measurement: bench/suite runs the
+ * pool on each of them.
+ */
+enum tpool_queue {
+    TPOOL_QUEUE_RING,
+    TPOOL_QUEUE_LIST,
+    TPOOL_QUEUE_MUTEX,
+    TPOOL_QUEUE_SPIN
+};
+
+/* With "priorities" set to more than one, the shared queue is one queue per
+ * level, of the kind above, each as lock-free as ever. Workers take from the
+ * most urgent level that has a job, ahead even of their own deque, so a job
+ * added with tpool_add_priority at level 0 never waits behind bulk work in
+ * the queue. The order is strict: a steady flow of urgent jobs starves the
+ * rest.
+ */
+struct tpool_level {
+    union { /* which one, the pool's "queue" says */
+        struct ring ring;
+        struct lfqueue list;
+        struct lockqueue locked;
+    };
+};
+
+/* How long a worker above min_threads idles before it retires, by default. */
+#define TPOOL_IDLE_MS 100
+
+/* What workers look up on their way round the loop and may change while the
+ * pool runs. It is never written in place but replaced whole, and the old
+ * copy retired: workers read it under the pool's QSBR (qsbr.h), without a
+ * lock or a fence, and other threads only while holding grow_lock, which a
+ * writer holds to swap it.
+ */
+struct tpool_config {
+    struct qsbr_node node; /* retired through it when replaced */
+    int target;            /* the most workers that may be active */
+    uint64_t idle_ns;      /* idle_ms, resolved */
+};
+
+/* Room in every future for a small result; see tpool_result_alloc. */
+#define TPOOL_INLINE_RESULT 16
+
+struct tpool;
+struct tpool_future;
+
+struct fiber;
+struct fiber_set;
+
+/* Whom a future tells when it is done: the batch it is part of, a job added
+ * with tpool_when_all that waits on it, or, under "fibers", the fiber of a
+ * job that waits on it in tpool_future_wait.
+ */
+struct tpool_link {
+    struct tpool_link *next;
+    struct tpool_future *dependent; /* NULL for a batch or a fiber */
+    struct fiber *fiber;            /* NULL for a batch or a dependent */
+    struct tpool_batch *batch;
+    atomic_int *done; /* the word of the batch */
+    int done_bit;
+};
+
+/* A job is fully described by its future, so the queue holds nothing but
+ * future pointers. Futures come from a slab the pool keeps, so submitting a
+ * job does not touch the heap once the pool has warmed up.
+ *
+ * Each future fills exactly one cache line of its own. The worker finishing a
+ * job writes "state" while its waiter polls it, and two futures on one line
+ * would have the waiter of one slow down the worker finishing the other. A
+ * TPOOL_STATS build stamps each future when added, which spills it onto two.
+ */
+struct tpool_future {
+    _Alignas(CACHE_LINE_SIZE) void *(*func)(void *);
+    void *arg;
+    union {
+        void *result;
+        atomic_int waiting; /* futures it waits on, until it is queued */
+    };
+    struct tpool *pool; /* whose slab the future goes back to */
+    _Atomic(struct tpool_link *) links; /* told when the job is done */
+    atomic_int state;
+#ifdef TPOOL_STATS
+    uint64_t added; /* stats_now() in add_job */
+#endif
+    _Alignas(max_align_t) unsigned char inline_result[TPOOL_INLINE_RESULT];
+};
+
+/* idle: jobs are queued but not taken; running: workers take them */
+enum state { idle, running, cancelled };
+
+#define TPOOL_CAPACITY 4096
+
+struct tpool_worker {
+    struct deque deque; /* TPOOL_SCHED_STEAL only */
+    struct tpool *pool;
+    unsigned int seed; /* picks the victims to steal from */
+    int node;          /* whose queues it serves */
+    int cpu;           /* where it runs, with "pin" */
+    struct fiber_set *fibers; /* under "fibers", what it runs jobs on */
+    int suspended;            /* of those, the ones stopped in a wait */
+#ifdef TPOOL_STATS
+    struct stats_counters stats;
+#endif
+};
+
+/* Options are fields set alongside "initialized" before tpool_init, for
+ * instance
+ *
+ *     tpool_t pool = { .initialized = ATOMIC_FLAG_INIT,
+ *                      .wait = TPOOL_WAIT_SPIN };
+ *
+ * and zero always means the default.
+ */
+typedef struct tpool {
+    atomic_flag initialized;
+    enum tpool_wait wait;
+    enum tpool_sched sched;
+    enum tpool_queue queue;
+    size_t capacity; /* jobs a bounded queue holds, TPOOL_CAPACITY by default */
+    int priorities;  /* levels of the shared queue, 1 by default */
+    /* Where the workers run. "nodes" splits the pool along NUMA nodes: each
+     * node gets shared queues of its own, served first by the node's own
+     * workers, and a worker that runs dry steals from its own node's workers
+     * first. A job goes on the queue of the node it is added from, so it stays
+     * near whatever its adder touched, and the futures come from the adder's
+     * slab cache, which the first-touch policy of Linux places on that node as
+     * well. Zero means the nodes the machine really has; a number makes that
+     * many up, to try the split on a machine with one node. With "pin", each
+     * worker is kept on one CPU of its node.
+     */
+    int nodes;       /* NUMA nodes to make up, the real ones by default */
+    bool pin;        /* each worker on a CPU of its own node */
+    /* How many workers run. The size given to tpool_init is the most there will
+     * ever be, and by default all of them start there and stay. With
+     * "min_threads" set below it, only that many start; whenever a job is added
+     * while every running worker is busy and more jobs are outstanding than
+     * there are workers, one more is started, or woken if it retired before, up
+     * to the target set with tpool_set_target, which is the size to begin with.
+     * A worker above min_threads that has found nothing to do for "idle_ms"
+     * retires, the last started first, and sleeps until the pool grows again.
+     * Retired workers keep their thread, so growing back costs a wake-up, not a
+     * thrd_create.
+     */
+    int min_threads; /* workers that always run, all of them by default */
+    int idle_ms;     /* before a surplus one parks, TPOOL_IDLE_MS by default */
+    bool fibers;     /* jobs that wait give their worker back; see below */
+    size_t fiber_stack; /* bytes per fiber, FIBER_STACK_SIZE by default */
+    int size;
+    thrd_t *pool;
+    struct tpool_worker *workers;
+    atomic_int state;
+    struct counter pending; /* jobs added but not yet finished */
+    atomic_int signal;      /* bumped to wake parked workers */
+    atomic_int parked;      /* workers asleep on "signal" */
+    thrd_start_t func;
+    int min;            /* min_threads, resolved */
+    atomic_int started; /* threads created, which never exit before destroy */
+    atomic_int active;  /* workers 0 to active - 1 run, the others retired */
+    atomic_int resize;  /* bumped to wake the retired ones */
+    mtx_t grow_lock;    /* one thread starting or waking workers at a time */
+    _Atomic(struct tpool_config *) config;
+    struct tpool_config initial; /* what config points to at first */
+    struct qsbr qsbr;            /* one reader per worker, over config */
+    struct topology topology;
+    struct tpool_level *levels; /* node by node, the most urgent first */
+    int nlevels;
+    struct slab list_nodes; /* TPOOL_QUEUE_LIST: of every level's queue */
+    struct slab futures;
+    struct slab links; /* for tpool_when_all */
+    struct ebr ebr; /* TPOOL_SCHED_STEAL: guards the deques' arrays */
+#ifdef TPOOL_STATS
+    struct stats_counters outside; /* what threads other than workers do */
+#endif
+} tpool_t;
+
+bool tpool_init(tpool_t *thrd_pool, size_t size);
+void tpool_destroy(tpool_t *thrd_pool);
+
+/* Safe from any thread, whatever the state of the pool. Called from one of
+ * the pool's own jobs under TPOOL_SCHED_STEAL, the job goes on that worker's
+ * deque, which has no fixed size. Otherwise a full ring pushes back on the
+ * caller: while the pool runs, add_job takes the oldest job and runs it in
+ * place to make room. A paused pool cannot make room that way, so there
+ * add_job fails instead, as it does when out of memory.
+ */
+struct tpool_future *add_job(tpool_t *thrd_pool, void *(*func)(void *),
+                             void *arg);
+
+/* add_job at a priority from 0, the most urgent, to "priorities" - 1, which
+ * is where add_job and every other way of adding a job put theirs. Jobs at
+ * any level but that last one go on the shared queue even from inside a job
+ * under TPOOL_SCHED_STEAL, so that any worker can pick them up first thing.
+ * A level past the last is taken as the last, and one below 0 as 0.
+ */
+struct tpool_future *tpool_add_priority(tpool_t *thrd_pool, int priority,
+                                        void *(*func)(void *), void *arg);
+
+/* add_job with an argument of size bytes, at most TPOOL_INLINE_RESULT, that
+ * is copied into the job's own future: func gets a pointer to the copy, and
+ * may write its result over it and return that same pointer, which is then
+ * the future's result as if from tpool_result_alloc. Nothing is allocated
+ * for either. typed.h builds job pools of a concrete type on this.
+ */
+struct tpool_future *tpool_add_inline(tpool_t *thrd_pool,
+                                      void *(*func)(void *), const void *arg,
+                                      size_t size);
+
+/* Add n jobs running func on args[0] to args[n - 1] at once, storing their
+ * futures in futures[]. The jobs go into the queue with one CAS between them
+ * however many there are, so a burst of small jobs costs a fraction of what
+ * as many add_job calls do. Each future is still waited on and destroyed on
+ * its own.
+ *
+ * Returns the number of jobs added, which is n unless add_job would have
+ * failed; futures[] past that count are set to NULL.
+ */
+size_t add_jobs(tpool_t *thrd_pool, void *(*func)(void *), void **args,
+                size_t n, struct tpool_future **futures);
+
+/* Completion bits for a batch of jobs, packed 30 to an int. Waiting for a
+ * thousand jobs this way polls 34 words on three cache lines rather than a
+ * thousand futures on as many lines, and a job finishing costs its worker one
+ * compare-and-swap on top of completing its future. The top bit of each word
+ * says the waiter sleeps on it, the one below that its fiber stopped on it.
+ */
+#define TPOOL_BATCH_BITS 30
+
+struct tpool_batch {
+    tpool_t *pool;
+    size_t size;     /* jobs added */
+    size_t capacity; /* jobs the bits have room for */
+    struct fiber *fiber; /* of the job stopped in tpool_batch_wait */
+    struct tpool_link *links; /* one per job, after the bits */
+    atomic_int done[];
+};
+
+struct tpool_batch *tpool_batch_create(size_t capacity);
+/* Only once tpool_batch_wait has returned: the jobs still write to it. */
+void tpool_batch_destroy(struct tpool_batch *batch);
+
+/* add_jobs, with the jobs also reporting to the batch; one thread adds to
+ * a given batch, and only jobs for one pool. Jobs past the capacity of the
+ * batch are not added.
+ */
+size_t tpool_batch_add(tpool_t *thrd_pool, struct tpool_batch *batch,
+                       void *(*func)(void *), void **args, size_t n,
+                       struct tpool_future **futures);
+/* Wait for every job added to the batch, helping as tpool_future_wait does,
+ * and under "fibers" stopping as it does as well. The futures are then all
+ * done, and still need destroying.
+ */
+void tpool_batch_wait(struct tpool_batch *batch);
+
+/* Indices begin to end - 1, cut into jobs of "grain" indices each. A grain of
+ * zero makes about TPOOL_REDUCE_JOBS jobs of the range, whatever the pool.
+ */
+struct tpool_range {
+    size_t begin, end;
+    size_t grain;
+};
+
+#define TPOOL_REDUCE_JOBS 256
+
+/* A reduction over results of "size" bytes. map folds the indices of one job
+ * into acc, which starts out as a copy of identity; combine folds other into
+ * acc, which holds the results of the indices just before other's.
+ */
+struct tpool_reduce {
+    void (*map)(void *acc, size_t begin, size_t end, void *ctx);
+    void (*combine)(void *acc, const void *other, void *ctx);
+    const void *identity;
+    size_t size;
+    void *ctx;
+};
+
+/* Reduce the range into result on the pool. Jobs combine their results
+ * pairwise as they finish, up a binary tree over the jobs, so the caller
+ * waits for one tree rather than collecting a future at a time, and nothing
+ * runs serially at the end.
+ *
+ * Which results are combined, and in which order, depends on the range and
+ * its grain only: with the same grain, a sum of doubles comes out bit for bit
+ * the same on any number of threads. combine need not be commutative.
+ *
+ * Safe from inside a job, which helps while it waits, and from outside,
+ * where the pool has to be running for it to return. Returns false, with
+ * result untouched, if out of memory.
+ */
+bool tpool_parallel_reduce(tpool_t *thrd_pool, struct tpool_range range,
+                           const struct tpool_reduce *reduce, void *result);
+
+/* employer asks workers to work */
+void tpool_run(tpool_t *thrd_pool);
+/* employer waits until every job added so far has finished */
+void tpool_wait_idle(tpool_t *thrd_pool);
+
+/* Called from inside a job, this runs other jobs of the pool until the future
+ * is done, rather than holding a worker hostage. That is what lets a job wait
+ * for the jobs it spawned without the pool running out of workers.
+ *
+ * Each job run that way sits on the stack of the one waiting, though, which
+ * cannot return before the job on top of it has, however long ago its own
+ * future was done. Deep recursion, as in divide and conquer, piles up the
+ * stack and holds up the waiters at the bottom of it. A pool with "fibers"
+ * set runs its workers on fibers (fiber.h) instead: a job of its own that
+ * waits on one of its futures stops right there and leaves its fiber, and
+ * its worker goes on with another fiber of its own. When the future is done,
+ * whoever completes it hands the fiber back, and the worker picks up the job
+ * where it stopped as soon as it is between jobs. Every job stopped that way
+ * holds a stack, which takes memory only as it is touched, and goes on on
+ * the worker it started on, which does not retire meanwhile.
+ */
+void tpool_future_wait(struct tpool_future *future);
+/* Futures live in their pool, so destroy them before it. */
+void tpool_future_destroy(struct tpool_future *future);
+
+/* Add a job running func(arg) once all n futures are done, n included, with
+ * no thread waiting for them: whichever completes last queues the job, on its
+ * own worker's deque under TPOOL_SCHED_STEAL. So jobs form a graph, and a
+ * stage of a pipeline starts the moment its inputs are ready. The futures
+ * belong to thrd_pool and are waited on and destroyed as usual, though not
+ * before this returns; a job reading their results has to outlive them.
+ *
+ * The job counts as pending from here on, so tpool_wait_idle waits for it.
+ * Returns its future, or NULL if out of memory.
+ */
+struct tpool_future *tpool_when_all(tpool_t *thrd_pool,
+                                    struct tpool_future **futures, size_t n,
+                                    void *(*func)(void *), void *arg);
+/* tpool_when_all of the one future */
+struct tpool_future *tpool_then(struct tpool_future *future,
+                                void *(*func)(void *), void *arg);
+
+/* Memory for a job to return its result in, freed with the future. Called
+ * from a job, once, for a result of at most TPOOL_INLINE_RESULT bytes, it is
+ * space inside the job's own future and costs nothing. Otherwise it is plain
+ * malloc, which is also what a job may return instead.
+ */
+void *tpool_result_alloc(size_t size);
+
+/* The node whose queues the calling thread adds jobs to: a worker's own, and
+ * for any other thread that of the CPU it runs on.
+ */
+int tpool_current_node(tpool_t *thrd_pool);
+
+/* Let the pool grow to n workers, or shrink to it as workers run out of
+ * work, within min_threads and the size it was created with. Safe from any
+ * thread; a pool without min_threads has nowhere to go. Returns false if
+ * there is no memory for the new configuration, which leaves the old one.
+ */
+bool tpool_set_target(tpool_t *thrd_pool, int n);
+/* workers running right now, as opposed to parked or not started */
+int tpool_active(tpool_t *thrd_pool);
+
+/* Add up the counters of every worker into stats while they keep working.
+ * Each counter is exact as of some moment during the call, though not all of
+ * them as of the same one. Returns false, with stats all zero, in a build
+ * without TPOOL_STATS; see stats.h.
+ */
+bool tpool_stats_snapshot(tpool_t *thrd_pool, struct tpool_stats *stats);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TPOOL_TYPED_H
+#define TPOOL_TYPED_H
+
+#include <string.h>
+
+#include "tpool.h"
+
+/* Jobs of one concrete type. add_job takes a void *(*)(void *) like the
+ * book's listing, so a job's argument and result travel as pointers, and
+ * bbp() has to malloc the one double it returns; the pool cannot see which
+ * function it calls either, so nothing is inlined.
+ *
+ *     TPOOL_TYPED(name, arg_type, result_type, fn)
+ *
+ * with fn a result_type fn(arg_type) declares
+ *
+ *     struct name_future *name_add(pool, arg)   NULL where add_job fails
+ *     result_type name_wait(f)                  tpool_future_wait, then
+ *                                               the result
+ *     void name_destroy(f)
+ *
+ * The argument is copied into the job's future and the result written over
+ * it (tpool_add_inline), so both have to fit in TPOOL_INLINE_RESULT bytes,
+ * which a _Static_assert checks. The pool, its queues and its workers are
+ * the ones add_job uses; what is specialized is one small function per type
+ * that unpacks the argument, calls fn directly, where the compiler is free
+ * to inline it, and packs the result. The workers still reach that function
+ * through the future's pointer, which is the one indirect call left.
+ *
+ * struct name_future is never defined: it is a tpool_future under another
+ * name, so that the future of one kind of job cannot be waited on as
+ * another's.
+ */
+#define TPOOL_TYPED(name, arg_type, result_type, fn)                          \
+    _Static_assert(sizeof(arg_type) <= TPOOL_INLINE_RESULT,                   \
+                   #arg_type " does not fit in a future");                    \
+    _Static_assert(sizeof(result_type) <= TPOOL_INLINE_RESULT,                \
+                   #result_type " does not fit in a future");                 \
+                                                                              \
+    struct name##_future;                                                     \
+                                                                              \
+    static void *name##_run(void *slot)                                       \
+    {                                                                         \
+        arg_type arg;                                                         \
+        memcpy(&arg, slot, sizeof(arg));                                      \
+        result_type result = fn(arg);                                         \
+        memcpy(slot, &result, sizeof(result));                                \
+        return slot;                                                          \
+    }                                                                         \
+                                                                              \
+    static inline struct name##_future *name##_add(tpool_t *pool,             \
+                                                   arg_type arg)              \
+    {                                                                         \
+        return (struct name##_future *)tpool_add_inline(pool, name##_run,     \
+                                                        &arg, sizeof(arg));   \
+    }                                                                         \
+                                                                              \
+    static inline result_type name##_wait(struct name##_future *f)            \
+    {                                                                         \
+        struct tpool_future *future = (struct tpool_future *)f;               \
+        tpool_future_wait(future);                                            \
+        result_type result;                                                   \
+        memcpy(&result, future->result, sizeof(result));                      \
+        return result;                                                        \
+    }                                                                         \
+                                                                              \
+    static inline void name##_destroy(struct name##_future *f)                \
+    {                                                                         \
+        tpool_future_destroy((struct tpool_future *)f);                       \
+    }
+
+#endif
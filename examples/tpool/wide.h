@@ -0,0 +1,163 @@
+#ifndef TPOOL_WIDE_H
+#define TPOOL_WIDE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cacheline.h"
+#include "order.h"
+#include "park.h"
+
+/* Atomic values of any size, for records too wide for the machine's widest
+ * CAS. The manuscript's "Arbitrarily-sized atomic types" section explains
+ * what _Atomic makes of those: calls into libatomic, which takes a lock from
+ * a small table hashed by address, so readers serialize on it and each of
+ * them writes the lock's line. rmw_example_aba.c pays that wherever its
+ * 16-byte CAS is not inlined.
+ *
+ * Here a sequence count guards the value instead. A writer makes it odd,
+ * stores the value, then makes it even again; a reader reads the count,
+ * copies the value, and reads the count once more, retrying if a write
+ * overlapped. Readers never write to shared memory, so any number of them
+ * read in parallel without taking each other's cache lines. The value is kept
+ * as atomic words accessed relaxed: a reader racing a writer reads mixed
+ * words, which the count then rejects, rather than committing a data race
+ * (Boehm, "Can Seqlocks Get Along with Programming Language Memory Models?",
+ * MSPC 2012).
+ *
+ * WIDE_ATOMIC(name, type) declares "struct name" holding a "type" and
+ *
+ *     name_init(a, &v)                     not atomic, before any sharing
+ *     name_load(a, &out)                   any number of readers
+ *     name_store(a, &v)                    one writer at a time
+ *     name_store_shared(a, &v)             any number of writers
+ *     name_compare_exchange(a, &exp, &v)   likewise, as for any _Atomic
+ *
+ * The shared writers claim the count with a CAS from even to odd, so they do
+ * wait for each other, though readers never hold them up. compare_exchange
+ * compares the bytes of the value, padding included, as
+ * atomic_compare_exchange does on a struct.
+ */
+
+typedef unsigned long wide_word;
+
+/* Every word and the count are atomic without a lock, or none of this is. */
+#define WIDE_LOCK_FREE (ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2)
+_Static_assert(WIDE_LOCK_FREE, "wide.h needs lock-free int and long atomics");
+
+#define WIDE_WORDS(type) \
+    ((sizeof(type) + sizeof(wide_word) - 1) / sizeof(wide_word))
+
+static inline void wide_load_words(const atomic_uint *seq,
+                                   const atomic_ulong *words, size_t n,
+                                   wide_word *out)
+{
+    while (1) {
+        unsigned int s = atomic_load_explicit(seq, mo_acquire);
+        if (!(s & 1)) {
+            for (size_t i = 0; i < n; i++)
+                out[i] = atomic_load_explicit(&words[i], mo_relaxed);
+            /* the words are read before the count is read again */
+            atomic_thread_fence(mo_acquire);
+            if (atomic_load_explicit(seq, mo_relaxed) == s)
+                return;
+        }
+        spin_pause();
+    }
+}
+
+/* Store with the count made odd already, and make it even again. */
+static inline void wide_publish_words(atomic_uint *seq, unsigned int odd,
+                                      atomic_ulong *words, size_t n,
+                                      const wide_word *in)
+{
+    /* the odd count is seen before any word it guards */
+    atomic_thread_fence(mo_release);
+    for (size_t i = 0; i < n; i++)
+        atomic_store_explicit(&words[i], in[i], mo_relaxed);
+    atomic_store_explicit(seq, odd + 1, mo_release);
+}
+
+/* Claim the count for writing, against other writers; returns it, odd. */
+static inline unsigned int wide_claim(atomic_uint *seq)
+{
+    unsigned int s = atomic_load_explicit(seq, mo_relaxed);
+    while (1) {
+        if (s & 1) {
+            spin_pause();
+            s = atomic_load_explicit(seq, mo_relaxed);
+        } else if (atomic_compare_exchange_weak_explicit(
+                       seq, &s, s + 1, mo_acquire, mo_relaxed)) {
+            return s + 1;
+        }
+    }
+}
+
+#define WIDE_ATOMIC(name, type)                                               \
+    struct name {                                                             \
+        _Alignas(CACHE_LINE_SIZE) atomic_uint seq;                            \
+        atomic_ulong words[WIDE_WORDS(type)];                                 \
+    };                                                                        \
+                                                                              \
+    static inline void name##_words(wide_word *w, const type *v)              \
+    {                                                                         \
+        w[WIDE_WORDS(type) - 1] = 0;                                          \
+        memcpy(w, v, sizeof(type));                                           \
+    }                                                                         \
+                                                                              \
+    static inline void name##_init(struct name *a, const type *v)             \
+    {                                                                         \
+        wide_word w[WIDE_WORDS(type)];                                        \
+        name##_words(w, v);                                                   \
+        atomic_init(&a->seq, 0);                                              \
+        for (size_t i = 0; i < WIDE_WORDS(type); i++)                         \
+            atomic_init(&a->words[i], w[i]);                                  \
+    }                                                                         \
+                                                                              \
+    static inline void name##_load(const struct name *a, type *out)           \
+    {                                                                         \
+        wide_word w[WIDE_WORDS(type)];                                        \
+        wide_load_words(&a->seq, a->words, WIDE_WORDS(type), w);              \
+        memcpy(out, w, sizeof(type));                                         \
+    }                                                                         \
+                                                                              \
+    static inline void name##_store(struct name *a, const type *v)            \
+    {                                                                         \
+        wide_word w[WIDE_WORDS(type)];                                        \
+        name##_words(w, v);                                                   \
+        unsigned int s = atomic_load_explicit(&a->seq, mo_relaxed) + 1;       \
+        atomic_store_explicit(&a->seq, s, mo_relaxed);                        \
+        wide_publish_words(&a->seq, s, a->words, WIDE_WORDS(type), w);        \
+    }                                                                         \
+                                                                              \
+    static inline void name##_store_shared(struct name *a, const type *v)     \
+    {                                                                         \
+        wide_word w[WIDE_WORDS(type)];                                        \
+        name##_words(w, v);                                                   \
+        unsigned int s = wide_claim(&a->seq);                                 \
+        wide_publish_words(&a->seq, s, a->words, WIDE_WORDS(type), w);        \
+    }                                                                         \
+                                                                              \
+    static inline bool name##_compare_exchange(struct name *a, type *expected, \
+                                               const type *desired)           \
+    {                                                                         \
+        wide_word w[WIDE_WORDS(type)], old[WIDE_WORDS(type)];                 \
+        unsigned int s = wide_claim(&a->seq);                                 \
+        for (size_t i = 0; i < WIDE_WORDS(type); i++)                         \
+            old[i] = atomic_load_explicit(&a->words[i], mo_relaxed);          \
+        if (memcmp(old, expected, sizeof(type))) {                            \
+            /* No word changed: hand back the even count claimed, so that     \
+             * readers that overlapped the claim need not retry.              \
+             */                                                               \
+            atomic_store_explicit(&a->seq, s - 1, mo_release);                \
+            memcpy(expected, old, sizeof(type));                              \
+            return false;                                                     \
+        }                                                                     \
+        name##_words(w, desired);                                             \
+        wide_publish_words(&a->seq, s, a->words, WIDE_WORDS(type), w);        \
+        return true;                                                          \
+    }
+
+#endif